@@ -0,0 +1,69 @@
+
+// Appended to stockfish.js. Where WebAssembly SIMD is supported, Stockfish()
+// loads stockfish-simd.js from the same directory instead, and falls back to
+// this build if it cannot be loaded. Pass { wasmSimd: false } to opt out.
+(function () {
+  var base = Stockfish;
+  var isNode = typeof module === 'object' && typeof require === 'function' && typeof process === 'object';
+  var scriptUrl = typeof document === 'object' && document.currentScript ? document.currentScript.src : '';
+  var simd = null; // Promise of the factory of the SIMD build, or null
+
+  // A module with an i8x16.popcnt, as in the wasm-feature-detect library
+  function simdSupported() {
+    try {
+      return WebAssembly.validate(Uint8Array.of(
+        0, 97, 115, 109, 1, 0, 0, 0, 1, 5, 1, 96, 0, 1, 123, 3, 2, 1, 0,
+        10, 10, 1, 8, 0, 65, 0, 253, 15, 253, 98, 11));
+    } catch (e) {
+      return false;
+    }
+  }
+
+  // The SIMD build has replaced the global Stockfish with its own factory
+  function loaded() {
+    var factory = Stockfish;
+    Stockfish = select;
+    return factory;
+  }
+
+  function loadSimd() {
+    return new Promise(function (resolve) {
+      var url = scriptUrl ? scriptUrl.replace(/[^\/]*$/, 'stockfish-simd.js') : 'stockfish-simd.js';
+
+      if (isNode) {
+        try {
+          resolve(require(__dirname + '/stockfish-simd.js'));
+        } catch (e) {
+          resolve(null);
+        }
+      } else if (typeof importScripts === 'function') {
+        try {
+          importScripts(url);
+          resolve(loaded());
+        } catch (e) {
+          resolve(null);
+        }
+      } else {
+        var script = document.createElement('script');
+        script.src = url;
+        script.onload = function () { resolve(loaded()); };
+        script.onerror = function () { resolve(null); };
+        document.head.appendChild(script);
+      }
+    });
+  }
+
+  function select(opts) {
+    // Threads of a running engine load the same build as their main thread
+    if (!simdSupported() || (opts && (opts['wasmSimd'] === false || opts['wasmModule'])))
+      return base(opts);
+
+    simd = simd || loadSimd();
+    return simd.then(function (factory) {
+      return factory ? factory(opts) : base(opts);
+    });
+  }
+
+  Stockfish = select;
+  if (isNode) module.exports = Stockfish;
+})();
@@ -94,6 +94,37 @@ const vector<string> Defaults = {
 
 } // namespace
 
+/// read_fens() fills 'fens' with the default bench positions ("default"), the
+/// current position ("current") or the non-empty lines of a file of FEN or EPD
+/// positions. It returns false if the file cannot be opened.
+
+bool read_fens(const Position& current, const string& fenFile, vector<string>& fens) {
+
+  if (fenFile == "default")
+      fens = Defaults;
+
+  else if (fenFile == "current")
+      fens.push_back(current.fen());
+
+  else
+  {
+      string fen;
+      ifstream file(fenFile);
+
+      if (!file.is_open())
+          return false;
+
+      while (getline(file, fen))
+          if (!fen.empty())
+              fens.push_back(fen);
+
+      file.close();
+  }
+
+  return true;
+}
+
+
 /// setup_bench() builds a list of UCI commands to be run by bench. There
 /// are five parameters: TT size in MB, number of search threads that
 /// should be used, the limit value spent for each position, a file name
@@ -120,28 +151,10 @@ vector<string> setup_bench(const Position& current, istream& is) {
 
   go = limitType == "eval" ? "eval" : "go " + limitType + " " + limit;
 
-  if (fenFile == "default")
-      fens = Defaults;
-
-  else if (fenFile == "current")
-      fens.push_back(current.fen());
-
-  else
+  if (!read_fens(current, fenFile, fens))
   {
-      string fen;
-      ifstream file(fenFile);
-
-      if (!file.is_open())
-      {
-          cerr << "Unable to open file " << fenFile << endl;
-          exit(EXIT_FAILURE);
-      }
-
-      while (getline(file, fen))
-          if (!fen.empty())
-              fens.push_back(fen);
-
-      file.close();
+      cerr << "Unable to open file " << fenFile << endl;
+      exit(EXIT_FAILURE);
   }
 
   list.emplace_back("setoption name Threads value " + threads);
@@ -20,8 +20,8 @@
 
 #include <cassert>
 #include <vector>
-#include <bitset>
 
+#include "bitbase_kpk.h"
 #include "bitboard.h"
 #include "types.h"
 
@@ -31,7 +31,7 @@ namespace {
   // Positions with the pawn on files E to H will be mirrored before probing.
   constexpr unsigned MAX_INDEX = 2*24*64*64; // stm * psq * wksq * bksq = 196608
 
-  std::bitset<MAX_INDEX> KPKBitbase;
+  static_assert(sizeof(KPKData) * 8 == MAX_INDEX, "KPKData should have a bit per index");
 
   // A KPK bitbase index is an integer in [0, IndexMax] range
   //
@@ -46,6 +46,8 @@ namespace {
     return int(wksq) | (bksq << 6) | (stm << 12) | (file_of(psq) << 13) | ((RANK_7 - rank_of(psq)) << 15);
   }
 
+#ifndef NDEBUG // The classification only checks KPKData, see Bitbases::init()
+
   enum Result {
     INVALID = 0,
     UNKNOWN = 1,
@@ -66,6 +68,8 @@ namespace {
     Result result;
   };
 
+#endif
+
 } // namespace
 
 
@@ -73,12 +77,18 @@ bool Bitbases::probe(Square wksq, Square wpsq, Square bksq, Color stm) {
 
   assert(file_of(wpsq) <= FILE_D);
 
-  return KPKBitbase[index(stm, bksq, wksq, wpsq)];
+  unsigned idx = index(stm, bksq, wksq, wpsq);
+  return KPKData[idx / 64] & (1ULL << (idx % 64));
 }
 
 
+/// Bitbases::init() classifies all KPK positions by retrograde analysis. The
+/// result is embedded as KPKData, so release builds skip it and debug builds
+/// only check that it matches.
+
 void Bitbases::init() {
 
+#ifndef NDEBUG
   std::vector<KPKPosition> db(MAX_INDEX);
   unsigned idx, repeat = 1;
 
@@ -92,13 +102,15 @@ void Bitbases::init() {
       for (repeat = idx = 0; idx < MAX_INDEX; ++idx)
           repeat |= (db[idx] == UNKNOWN && db[idx].classify(db) != UNKNOWN);
 
-  // Fill the bitbase with the decisive results
+  // Check the bitbase against the decisive results
   for (idx = 0; idx < MAX_INDEX; ++idx)
-      if (db[idx] == WIN)
-          KPKBitbase.set(idx);
+      assert(bool(KPKData[idx / 64] & (1ULL << (idx % 64))) == (db[idx] == WIN));
+#endif
 }
 
 
+#ifndef NDEBUG
+
 namespace {
 
   KPKPosition::KPKPosition(unsigned idx) {
@@ -170,3 +182,5 @@ namespace {
   }
 
 } // namespace
+
+#endif
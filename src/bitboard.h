@@ -36,6 +36,7 @@ namespace Bitboards {
 
 void init();
 const std::string pretty(Bitboard b);
+const std::string attacks_speed();
 
 }
 
@@ -80,6 +81,21 @@ extern Bitboard PseudoAttacks[PIECE_TYPE_NB][SQUARE_NB];
 extern Bitboard PawnAttacks[COLOR_NB][SQUARE_NB];
 
 
+#ifdef USE_HYPERBOLA
+
+/// Lines holds the file and the two diagonals through a square, without the
+/// square itself. Together with RankAttacks[], indexed by the 6 inner squares
+/// of a rank and the file, they are all the tables needed to compute the
+/// attacks of sliding pieces, see line_attacks().
+struct Lines {
+  Bitboard file, diagonal, antiDiagonal;
+};
+
+extern Lines SliderLines[SQUARE_NB];
+extern uint8_t RankAttacks[64][FILE_NB];
+
+#else
+
 /// Magic holds all magic bitboards relevant data for a single square
 struct Magic {
   Bitboard  mask;
@@ -105,6 +121,8 @@ struct Magic {
 extern Magic RookMagics[SQUARE_NB];
 extern Magic BishopMagics[SQUARE_NB];
 
+#endif
+
 inline Bitboard square_bb(Square s) {
   assert(is_ok(s));
   return SquareBB[s];
@@ -303,6 +321,44 @@ inline Bitboard attacks_bb(Square s) {
 }
 
 
+#ifdef USE_HYPERBOLA
+
+/// byteswap() mirrors a bitboard vertically, rank 1 becoming rank 8
+
+inline Bitboard byteswap(Bitboard b) {
+#if defined(__GNUC__)
+  return __builtin_bswap64(b);
+#else
+  return _byteswap_uint64(b);
+#endif
+}
+
+
+/// line_attacks() returns the attacks along a file or a diagonal, computed
+/// with the "hyperbola quintessence": subtracting the slider from the occupied
+/// squares of the line flips the bits up to the first blocker above it, and
+/// doing the same on the byteswapped board finds the first blocker below it.
+/// As a reference see www.chessprogramming.org/Hyperbola_Quintessence. A rank
+/// is not mirrored by byteswap(), so rank attacks come from RankAttacks[].
+
+inline Bitboard line_attacks(Square s, Bitboard occupied, Bitboard line) {
+
+  Bitboard forward = occupied & line;
+  Bitboard reverse = byteswap(forward);
+  forward -= square_bb(s);
+  reverse -= byteswap(square_bb(s));
+  return (forward ^ byteswap(reverse)) & line;
+}
+
+inline Bitboard rank_attacks(Square s, Bitboard occupied) {
+
+  const int shift = 8 * rank_of(s);
+  return Bitboard(RankAttacks[(occupied >> (shift + 1)) & 63][file_of(s)]) << shift;
+}
+
+#endif
+
+
 /// attacks_bb(Square, Bitboard) returns the attacks by the given piece
 /// assuming the board is occupied according to the passed Bitboard.
 /// Sliding piece attacks do not continue passed an occupied square.
@@ -314,8 +370,15 @@ inline Bitboard attacks_bb(Square s, Bitboard occupied) {
 
   switch (Pt)
   {
+#ifdef USE_HYPERBOLA
+  case BISHOP: return  line_attacks(s, occupied, SliderLines[s].diagonal)
+                     | line_attacks(s, occupied, SliderLines[s].antiDiagonal);
+  case ROOK  : return  line_attacks(s, occupied, SliderLines[s].file)
+                     | rank_attacks(s, occupied);
+#else
   case BISHOP: return BishopMagics[s].attacks[BishopMagics[s].index(occupied)];
   case ROOK  : return   RookMagics[s].attacks[  RookMagics[s].index(occupied)];
+#endif
   case QUEEN : return attacks_bb<BISHOP>(s, occupied) | attacks_bb<ROOK>(s, occupied);
   default    : return PseudoAttacks[Pt][s];
   }
@@ -21,11 +21,9 @@
 #include <iostream>
 
 #include "bitboard.h"
-#include "endgame.h"
 #include "position.h"
 #include "search.h"
 #include "thread.h"
-#include "tt.h"
 #include "uci.h"
 
 namespace PSQT {
@@ -34,18 +32,25 @@ namespace PSQT {
 
 int main(int argc, char* argv[]) {
 
+#ifdef __EMSCRIPTEN__
+  start_mailbox();
+#endif
+
   std::cout << engine_info() << std::endl;
 
-  UCI::init(Options);
-  Tune::init();
-  PSQT::init();
-  Bitboards::init();
-  Position::init();
-  Bitbases::init();
-  Endgames::init();
-  Threads.set(size_t(Options["Threads"]));
-  TT.resize(Options["Hash"]); // After threads are up
-  Search::clear(); // After threads are up
+  Startup::timed("UCI::init",       [] { UCI::init(Options); });
+  Startup::timed("Tune::init",      [] { Tune::init(); });
+  Startup::timed("PSQT::init",      [] { PSQT::init(); });
+  Startup::timed("Bitboards::init", [] { Bitboards::init(); });
+  Startup::timed("Position::init",  [] { Position::init(); });
+  Startup::timed("Bitbases::init",  [] { Bitbases::init(); });
+
+  // The endgame maps, threads and hash table are set up by the first command
+  // that needs them, see UCI::init_search().
+
+#ifdef __EMSCRIPTEN__
+  std::thread(UCI::mailbox_loop).detach(); // Commands are read from here on
+#endif
 
   return 0;
 }
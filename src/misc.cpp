@@ -41,6 +41,10 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 }
 #endif
 
+#include <algorithm>
+#include <cerrno>
+#include <climits>
+#include <cmath>
 #include <fstream>
 #include <iomanip>
 #include <iostream>
@@ -48,8 +52,16 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 #include <vector>
 
 #if defined(__linux__) && !defined(__ANDROID__)
+#include <fcntl.h>
 #include <stdlib.h>
 #include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifdef __EMSCRIPTEN__
+#include <emscripten.h>
+#include <emscripten/threading.h>
 #endif
 
 #include "misc.h"
@@ -57,6 +69,8 @@ typedef bool(*fun3_t)(HANDLE, CONST GROUP_AFFINITY*, PGROUP_AFFINITY);
 
 using namespace std;
 
+Mailbox CommandBox, OutputBox; // Global objects
+
 namespace {
 
 /// Version number. If Version is left empty, then compile date in the format
@@ -126,8 +140,147 @@ public:
   }
 };
 
+/// MailboxBuf is the streambuf that std::cout writes to in the wasm build.
+/// Output is collected in a small put area and handed to the mailbox on each
+/// flush, so that a line written with sync_endl becomes a single write.
+
+struct MailboxBuf: public streambuf {
+
+  MailboxBuf(Mailbox& m) : box(m) { setp(buf, buf + sizeof(buf)); }
+
+  int sync() override {
+    box.write(pbase(), size_t(pptr() - pbase()));
+    setp(buf, buf + sizeof(buf));
+    return 0;
+  }
+
+  int overflow(int c) override {
+    sync();
+    return c == EOF ? 0 : sputc((char)c);
+  }
+
+  Mailbox& box;
+  char buf[4096];
+};
+
+/// wait_while() blocks until the value of a mailbox field may have changed.
+/// Spurious returns are fine, callers check again.
+
+void wait_while(std::atomic<int32_t>& field, int32_t value) {
+
+#ifdef __EMSCRIPTEN__
+  emscripten_futex_wait(&field, uint32_t(value), INFINITY);
+#else
+  // There is no JavaScript side in native builds, only tests use mailboxes
+  if (field == value)
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+#endif
+}
+
+void wake(std::atomic<int32_t>& field) {
+
+#ifdef __EMSCRIPTEN__
+  emscripten_futex_wake(&field, INT_MAX);
+#else
+  (void)field;
+#endif
+}
+
 } // namespace
 
+
+/// Mailbox::write() copies n bytes into the buffer, waiting for the reader to
+/// make room whenever it is full, so that a line longer than the buffer is
+/// passed in pieces. The JavaScript reader cannot block, instead it sets
+/// 'waiting' when it is idle and we call Module.onOutput() to wake it up.
+
+void Mailbox::write(const char* s, size_t n) {
+
+  while (n)
+  {
+      int32_t h = head, t = tail;
+      size_t room = size_t((h - t - 1 + Size) % Size);
+
+      if (!room)
+      {
+          wait_while(head, h);
+          continue;
+      }
+
+      size_t cnt = std::min(n, room);
+
+      for (size_t i = 0; i < cnt; ++i)
+          data[(t + i) % Size] = s[i];
+
+      tail = int32_t((t + cnt) % Size); // Publishes the data
+      s += cnt;
+      n -= cnt;
+
+      if (waiting.exchange(0))
+      {
+#ifdef __EMSCRIPTEN__
+          MAIN_THREAD_ASYNC_EM_ASM({ Module['onOutput'](); });
+#endif
+      }
+  }
+}
+
+
+/// Mailbox::read_line() returns the next line without the trailing newline,
+/// blocking until the writer has completed one. It returns false once the
+/// mailbox has been closed and drained.
+
+bool Mailbox::read_line(std::string& line) {
+
+  while (true)
+  {
+      size_t nl = partial.find('\n');
+      if (nl != string::npos)
+      {
+          line = partial.substr(0, nl);
+          partial.erase(0, nl + 1);
+          return true;
+      }
+
+      int32_t h = head, t = tail;
+
+      if (h == t)
+      {
+          if (closed)
+              return false;
+
+          wait_while(tail, t);
+          continue;
+      }
+
+      for ( ; h != t; h = (h + 1) % Size)
+          partial += data[h];
+
+      head = h;
+      wake(head);
+  }
+}
+
+
+/// Mailbox::close() makes read_line() return false once the buffer is empty
+
+void Mailbox::close() {
+
+  closed = 1;
+  wake(tail);
+}
+
+
+/// start_mailbox() makes std::cout write to OutputBox. It must be called
+/// before any other thread writes to std::cout.
+
+void start_mailbox() {
+
+  static MailboxBuf buf(OutputBox);
+  cout.rdbuf(&buf);
+}
+
+
 /// engine_info() returns the full name of the current Stockfish version. This
 /// will be either "Stockfish <Tag> DD-MM-YY" (where DD-MM-YY is the date when
 /// the program was compiled) or "Stockfish <Version>", depending on whether
@@ -246,6 +399,33 @@ void dbg_print() {
 }
 
 
+/// Startup::record() and Startup::report() collect and print the time of the
+/// initialization steps, see the 'startup' command.
+
+namespace {
+  vector<pair<string, TimePoint>> StartupSteps;
+}
+
+void Startup::record(const string& step, TimePoint micros) {
+  StartupSteps.emplace_back(step, micros);
+}
+
+string Startup::report() {
+
+  stringstream ss;
+  TimePoint total = 0;
+
+  for (auto& s : StartupSteps)
+  {
+      ss << setw(16) << left << s.first << ": " << setw(8) << right << s.second << " us\n";
+      total += s.second;
+  }
+  ss << setw(16) << left << "Total" << ": " << setw(8) << right << total << " us";
+
+  return ss.str();
+}
+
+
 /// Used to serialize access to std::cout to avoid multiple threads writing at
 /// the same time.
 
@@ -420,6 +600,77 @@ void aligned_ttmem_free(void *mem) {
 #endif
 
 
+/// shared_ttmem_alloc() maps the named shared memory object, creating it if it
+/// does not exist yet, so that several processes can use the same transposition
+/// table. The created flag tells whether the memory is fresh or is already in
+/// use by another process. Returns nullptr on failure or on platforms without
+/// support for it. The object outlives the processes until it is removed with
+/// shared_ttmem_unlink(), or e.g. from /dev/shm on Linux.
+
+#if defined(USE_SHARED_TTMEM)
+
+void* shared_ttmem_alloc(const std::string& name, size_t allocSize, bool& created) {
+
+  created = true;
+  int fd = shm_open(name.c_str(), O_RDWR | O_CREAT | O_EXCL, 0600);
+
+  if (fd == -1 && errno == EEXIST)
+  {
+      created = false;
+      fd = shm_open(name.c_str(), O_RDWR, 0600);
+  }
+
+  if (fd == -1)
+      return nullptr;
+
+  struct stat statbuf;
+
+  // The size is not set yet if we are the creator, or if the creator is still
+  // initializing. Never resize an object that is already mapped elsewhere.
+  if (   fstat(fd, &statbuf) == -1
+      || (statbuf.st_size != 0 && size_t(statbuf.st_size) != allocSize)
+      || (statbuf.st_size == 0 && ftruncate(fd, allocSize) == -1))
+  {
+      close(fd);
+      return nullptr;
+  }
+
+  void* mem = mmap(nullptr, allocSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+  close(fd);
+
+  if (mem == MAP_FAILED)
+      return nullptr;
+
+  madvise(mem, allocSize, MADV_HUGEPAGE);
+  return mem;
+}
+
+void shared_ttmem_free(void* mem, size_t allocSize) {
+
+  if (mem)
+      munmap(mem, allocSize);
+}
+
+void shared_ttmem_unlink(const std::string& name) {
+
+  shm_unlink(name.c_str());
+}
+
+#else
+
+void* shared_ttmem_alloc(const std::string&, size_t, bool& created) {
+
+  created = false;
+  return nullptr;
+}
+
+void shared_ttmem_free(void*, size_t) {}
+
+void shared_ttmem_unlink(const std::string&) {}
+
+#endif
+
+
 namespace WinProcGroup {
 
 #ifndef _WIN32
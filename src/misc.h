@@ -21,6 +21,7 @@
 #ifndef MISC_H_INCLUDED
 #define MISC_H_INCLUDED
 
+#include <atomic>
 #include <cassert>
 #include <chrono>
 #include <ostream>
@@ -35,6 +36,13 @@ void prefetch(void* addr);
 void start_logger(const std::string& fname);
 void* aligned_ttmem_alloc(size_t size, void*& mem);
 void aligned_ttmem_free(void* mem); // nop if mem == nullptr
+void* shared_ttmem_alloc(const std::string& name, size_t size, bool& created);
+void shared_ttmem_free(void* mem, size_t size); // nop if mem == nullptr
+void shared_ttmem_unlink(const std::string& name);
+
+#if defined(__linux__) && !defined(__ANDROID__)
+#define USE_SHARED_TTMEM // Named shared memory mappings are supported
+#endif
 
 void dbg_hit_on(bool b);
 void dbg_hit_on(bool c, bool b);
@@ -50,12 +58,69 @@ inline TimePoint now() {
         (std::chrono::steady_clock::now().time_since_epoch()).count();
 }
 
+inline TimePoint now_micros() { // For timing steps that take less than 1 ms
+  return std::chrono::duration_cast<std::chrono::microseconds>
+        (std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+/// Startup keeps the time taken by each initialization step, in microseconds,
+/// for the 'startup' command. Steps that main() defers to the first command
+/// that needs them, see UCI::init_search(), are listed last.
+namespace Startup {
+
+  void record(const std::string& step, TimePoint micros);
+  std::string report();
+
+  // Runs an initialization step and records how long it took
+  template<typename F>
+  void timed(const char* step, F init) {
+
+    TimePoint start = now_micros();
+    init();
+    record(step, now_micros() - start);
+  }
+}
+
+/// HashTable is a per-thread cache of evaluation terms, used for the pawn and
+/// material tables. Size is the default number of entries; resize() changes
+/// it at runtime to the largest power of 2 that fits in the given KB. Probes
+/// and hits are counted for the 'memory' debug command when compiled with
+/// HASH_STATS ('make hashstats=yes').
+
 template<class Entry, int Size>
 struct HashTable {
-  Entry* operator[](Key key) { return &table[(uint32_t)key & (Size - 1)]; }
+
+  static constexpr int DefaultKB = int(Size * sizeof(Entry) / 1024);
+
+  Entry* operator[](Key key) {
+    Entry* e = &table[(uint32_t)key & mask];
+#ifdef HASH_STATS
+    ++probes;
+    hits += e->key == key;
+#endif
+    return e;
+  }
+
+  void resize(size_t kbSize) {
+    size_t n = 1;
+    while (2 * n * sizeof(Entry) <= kbSize * 1024)
+        n *= 2;
+
+    if (n != table.size())
+    {
+        table = std::vector<Entry>(n);
+        mask = uint32_t(n - 1);
+        probes = hits = 0;
+    }
+  }
+
+  size_t bytes() const { return table.size() * sizeof(Entry); }
+
+  uint64_t probes = 0, hits = 0;
 
 private:
   std::vector<Entry> table = std::vector<Entry>(Size); // Allocate on the heap
+  uint32_t mask = Size - 1;
 };
 
 
@@ -65,6 +130,35 @@ std::ostream& operator<<(std::ostream&, SyncCout);
 #define sync_cout std::cout << IO_LOCK
 #define sync_endl std::endl << IO_UNLOCK
 
+
+/// Mailbox is a ring buffer of bytes in the shared wasm memory, used to pass
+/// UCI commands and output lines between JavaScript and the engine without
+/// a setTimeout or a proxied syscall per line. There is a single writer, which
+/// only advances tail, and a single reader, which only advances head, so
+/// neither side takes a lock. The fields are 32 bit so that JavaScript can use
+/// Atomics.wait() and Atomics.notify() on them, see pre.js for the other side.
+
+struct Mailbox {
+
+  static constexpr int32_t Size = 1 << 16;
+
+  void write(const char* s, size_t n); // Blocks while the buffer is full
+  bool read_line(std::string& line);   // Blocks while the buffer is empty
+  void close();
+
+  std::atomic<int32_t> head, tail;
+  std::atomic<int32_t> waiting; // Set by a reader that asks to be notified
+  std::atomic<int32_t> closed;
+  char data[Size];
+  std::string partial;
+};
+
+static_assert(sizeof(std::atomic<int32_t>) == 4, "Mailbox layout is shared with pre.js");
+
+extern Mailbox CommandBox, OutputBox;
+
+void start_mailbox(); // Redirects std::cout to OutputBox
+
 namespace Utility {
 
 /// Clamp a value between lo and hi. Available in c++17.
@@ -1130,6 +1130,25 @@ bool Position::has_repeated() const {
 }
 
 
+// Position::history_key() returns a key of what the result of a search also
+// depends on besides the position: the rule50 count and the positions since
+// the last capture or pawn move, which may be repeated.
+
+Key Position::history_key() const {
+
+    Key k = Key(st->rule50);
+    StateInfo* stc = st;
+    int end = std::min(st->rule50, st->pliesFromNull);
+
+    while (end-- > 0 && stc->previous)
+    {
+        stc = stc->previous;
+        k = (k ^ stc->key) * 0x9E3779B97F4A7C15ULL;
+    }
+    return k;
+}
+
+
 /// Position::has_game_cycle() tests if the position has a move which draws by repetition,
 /// or an earlier position has a move that directly reaches the current position.
 
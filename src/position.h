@@ -25,6 +25,7 @@
 #include <deque>
 #include <memory> // For std::unique_ptr
 #include <string>
+#include <vector>
 
 #include "bitboard.h"
 #include "types.h"
@@ -60,8 +61,17 @@ struct StateInfo {
 /// A list to keep track of the position states along the setup moves (from the
 /// start position to the position just before the search starts). Needed by
 /// 'draw by repetition' detection. Use a std::deque because pointers to
-/// elements are not invalidated upon list resizing.
-typedef std::unique_ptr<std::deque<StateInfo>> StateListPtr;
+/// elements are not invalidated upon list resizing. The list also records the
+/// FEN and the moves it was set up from, so that the next 'position' command
+/// only has to play the moves that were added.
+struct StateList : public std::deque<StateInfo> {
+  using std::deque<StateInfo>::deque;
+
+  std::string fen;
+  std::vector<Move> moves;
+};
+
+typedef std::unique_ptr<StateList> StateListPtr;
 
 
 /// Position class stores information regarding the board representation as
@@ -154,6 +164,7 @@ public:
   bool is_draw(int ply) const;
   bool has_game_cycle(int ply) const;
   bool has_repeated() const;
+  Key history_key() const;
   int rule50_count() const;
   Score psq_score() const;
   Value non_pawn_material(Color c) const;
@@ -3,11 +3,74 @@
 
   var quit = false;
   var listeners = [];
+  var batchListeners = [];
+
+  // Output is delivered in batches, one per drain of the output mailbox. With
+  // a coalescing interval, drains happen at most once per interval and search
+  // info that is superseded within a batch is left out.
+  var interval = Module['outputInterval'] || 0;
+  var timer = null;
+  var stats = { 'lines': 0, 'batches': 0, 'coalesced': 0 };
+
+  // Timing of the last 'go': how long it waited to be written to the command
+  // mailbox, and until its first info line arrived. The engine reports the
+  // steps in between with the 'latency' command.
+  var clock = typeof performance === 'object' ? performance : Date;
+  var posted = 0, written = 0, goSeq = -1, goStart = 0;
+  var goTimes = { 'queued': null, 'firstInfo': null };
+
+  // Lines with the same key replace each other: the PV lines of one multipv
+  // index, or the current move reports. Other output is never coalesced.
+  function infoKey(line) {
+    if (line.indexOf('info ') !== 0) return null;
+    if (line.indexOf(' pv ') >= 0) {
+      var m = / multipv (\d+)/.exec(line);
+      return 'pv' + (m ? m[1] : '1');
+    }
+    return line.indexOf(' currmove ') >= 0 ? 'currmove' : null;
+  }
+
+  function coalesce(lines) {
+    var out = [], latest = {};
+    for (var i = 0; i < lines.length; i++) {
+      var key = infoKey(lines[i]);
+      if (key === null) {
+        if (lines[i].indexOf('info ') !== 0) latest = {}; // Keep the order around bestmove etc.
+      } else {
+        if (latest.hasOwnProperty(key)) {
+          out[latest[key]] = null;
+          stats['coalesced']++;
+        }
+        latest[key] = out.length;
+      }
+      out.push(lines[i]);
+    }
+    return out.filter(function (line) { return line !== null; });
+  }
+
+  function deliver(lines) {
+    if (goTimes['firstInfo'] === null && goSeq >= 0)
+      for (var i = 0; i < lines.length; i++)
+        if (lines[i].indexOf('info depth') >= 0) {
+          goTimes['firstInfo'] = clock.now() - goStart;
+          break;
+        }
+
+    stats['lines'] += lines.length;
+    if (interval) lines = coalesce(lines);
+    if (!lines.length) return;
+    stats['batches']++;
+
+    if (listeners.length === 0 && batchListeners.length === 0)
+      for (var i = 0; i < lines.length; i++) console.log(lines[i]);
+    for (var i = 0; i < listeners.length; i++)
+      for (var j = 0; j < lines.length; j++) listeners[i](lines[j]);
+    for (var i = 0; i < batchListeners.length; i++) batchListeners[i](lines);
+  }
 
   Module['print'] = function (line) {
-    if (listeners.length === 0) console.log(line);
-    else setTimeout(function () {
-      for (var i = 0; i < listeners.length; i++) listeners[i](line);
+    setTimeout(function () {
+      deliver([line]);
     });
   };
 
@@ -20,37 +83,137 @@
     if (idx >= 0) listeners.splice(idx, 1);
   };
 
+  Module['addBatchListener'] = function (listener) {
+    batchListeners.push(listener);
+  };
+
+  Module['removeBatchListener'] = function (listener) {
+    var idx = batchListeners.indexOf(listener);
+    if (idx >= 0) batchListeners.splice(idx, 1);
+  };
+
+  Module['setOutputInterval'] = function (ms) {
+    interval = ms;
+  };
+
+  Module['outputStats'] = function () {
+    return { 'lines': stats['lines'], 'batches': stats['batches'], 'coalesced': stats['coalesced'] };
+  };
+
+  Module['goLatency'] = function () {
+    return { 'queued': goTimes['queued'], 'firstInfo': goTimes['firstInfo'] };
+  };
+
   Module['terminate'] = function () {
     quit = true;
     PThread.terminateAllThreads();
   };
 
-  // Command queue
+  // Mailboxes in shared memory, see struct Mailbox in misc.h. Each one is
+  // laid out as int32 head, tail, waiting, closed followed by the data.
 
-  var queue = [];
-  var backoff = 1;
+  var SIZE = 1 << 16;
+  var HEAD = 0, TAIL = 1, WAITING = 2, DATA = 16;
 
-  function poll() {
-    var command = queue.shift();
-    if (quit || command === undefined) return;
+  var commandBox, outputBox; // Byte addresses
+  var pending = [];          // Encoded commands that did not fit yet
+  var partial = '';
+  var encoder = new TextEncoder();
+  var decoder = new TextDecoder();
 
-    if (command === 'quit') return Module['terminate']();
+  function views() {
+    var buffer = wasmMemory.buffer; // Changes when memory grows
+    return { i32: new Int32Array(buffer), u8: new Uint8Array(buffer) };
+  }
+
+  // Write pending commands, then wake the command thread. A command that does
+  // not fit is written in pieces as the engine makes room.
+  function send() {
+    var v = views(), box = commandBox >> 2;
+
+    while (!quit && pending.length) {
+      var bytes = pending[0];
+      var head = Atomics.load(v.i32, box + HEAD);
+      var tail = Atomics.load(v.i32, box + TAIL);
+      var n = Math.min(bytes.length, (head - tail - 1 + SIZE) % SIZE);
+
+      if (n === 0) return setTimeout(send, 1);
 
-    var tryLater = Module['ccall']('uci_command', 'number', ['string'], [command]);
-    if (tryLater) queue.unshift(command);
-    backoff = tryLater ? (backoff * 2) : 1;
-    setTimeout(poll, backoff);
+      for (var i = 0; i < n; i++)
+        v.u8[commandBox + DATA + (tail + i) % SIZE] = bytes[i];
+
+      Atomics.store(v.i32, box + TAIL, (tail + n) % SIZE);
+      Atomics.notify(v.i32, box + TAIL);
+
+      if (n === bytes.length) {
+        pending.shift();
+        if (written++ === goSeq) goTimes['queued'] = clock.now() - goStart;
+      }
+      else pending[0] = bytes.subarray(n);
+    }
   }
 
+  // Read all complete output lines. We cannot block, so before returning we
+  // set the waiting flag and the engine calls onOutput() with its next write.
+  function receive() {
+    var v = views(), box = outputBox >> 2, batch = [];
+    timer = null;
+
+    while (!quit) {
+      var head = Atomics.load(v.i32, box + HEAD);
+      var tail = Atomics.load(v.i32, box + TAIL);
+
+      if (head === tail) {
+        Atomics.store(v.i32, box + WAITING, 1);
+        if (Atomics.load(v.i32, box + TAIL) === tail) return deliver(batch);
+        Atomics.store(v.i32, box + WAITING, 0);
+        continue;
+      }
+
+      var start = outputBox + DATA;
+      var chunk = tail > head
+        ? v.u8.slice(start + head, start + tail)
+        : concat(v.u8.slice(start + head, start + SIZE), v.u8.slice(start, start + tail));
+
+      Atomics.store(v.i32, box + HEAD, tail);
+      Atomics.notify(v.i32, box + HEAD);
+
+      var lines = (partial + decoder.decode(chunk, { stream: true })).split('\n');
+      partial = lines.pop();
+      batch.push.apply(batch, lines);
+    }
+  }
+
+  function concat(a, b) {
+    var c = new Uint8Array(a.length + b.length);
+    c.set(a);
+    c.set(b, a.length);
+    return c;
+  }
+
+  Module['onOutput'] = function () {
+    if (!outputBox || timer !== null) return;
+    if (interval) timer = setTimeout(receive, interval);
+    else receive();
+  };
+
   Module['postMessage'] = function (command) {
-    queue.push(command);
+    if (command === 'quit') return Module['terminate']();
+    if (command === 'stop' && commandBox) Module['ccall']('uci_stop', null, [], []);
+    if (command.indexOf('go') === 0) {
+      goSeq = posted;
+      goStart = clock.now();
+      goTimes = { 'queued': null, 'firstInfo': null };
+    }
+    posted++;
+    pending.push(encoder.encode(command + '\n'));
+    if (commandBox && pending.length === 1) send();
   };
 
   Module['postRun'] = function () {
-    Module['postMessage'] = function (command) {
-      queue.push(command);
-      if (queue.length === 1) poll();
-    };
-    poll();
+    commandBox = Module['ccall']('uci_mailbox', 'number', ['number'], [0]);
+    outputBox = Module['ccall']('uci_mailbox', 'number', ['number'], [1]);
+    receive();
+    send();
   };
 })();
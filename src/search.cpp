@@ -36,11 +36,6 @@
 #include "tt.h"
 #include "uci.h"
 
-namespace Search {
-
-  LimitsType Limits;
-}
-
 using std::string;
 using Eval::evaluate;
 using namespace Search;
@@ -86,7 +81,7 @@ namespace {
     explicit Skill(int l) : level(l) {}
     bool enabled() const { return level < 20; }
     bool time_to_pick(Depth depth) const { return depth == 1 + level; }
-    Move pick_best(size_t multiPV);
+    Move pick_best(const RootMoves& rootMoves, size_t multiPV);
 
     int level;
     Move best = MOVE_NONE;
@@ -187,14 +182,19 @@ void Search::init() {
 }
 
 
-/// Search::clear() resets search state to its initial value
+/// Search::clear() resets search state to its initial value. A shared hash is
+/// only cleared if asked for, as with the 'Clear Hash' option.
 
-void Search::clear() {
+void Search::clear(bool sharedHash) {
 
   Threads.main()->wait_for_search_finished();
 
-  Time.availableNodes = 0;
-  TT.clear();
+  Threads.time.availableNodes = 0;
+
+  // A shared table also holds the results of other processes
+  if (!TT.is_shared() || sharedHash)
+      TT.clear();
+
   Threads.clear();
 }
 
@@ -205,33 +205,46 @@ void Search::clear() {
 void MainThread::search() {
 
   // (D) Initialize startTime on the same thread that will measure
-  // Time.elapsed(), because even steady clocks are not properly synchronized
+  // time.elapsed(), because even steady clocks are not properly synchronized
   // between WASM threads.
-  Search::Limits.startTime = now();
+  pool->limits.startTime = now();
+  pool->trace.mainStart = now_micros();
+
+  if (pool->limits.latency)
+      callsCnt = 0; // Check the time from the first node on
 
-  if (Limits.perft)
+  if (pool->limits.perft)
   {
-      nodes = perft<true>(rootPos, Limits.perft);
-      sync_cout << "\nNodes searched: " << nodes << "\n" << sync_endl;
+      nodes = perft<true>(rootPos, pool->limits.perft);
+      sync_cout << "\n" << pool->label << "Nodes searched: " << nodes << "\n" << sync_endl;
       return;
   }
 
   Color us = rootPos.side_to_move();
-  Time.init(Limits, us, rootPos.game_ply());
-  TT.new_search();
+  pool->time.init(pool->limits, us, rootPos.game_ply());
+
+  // Only the session a table belongs to advances its generation, TT belonging
+  // to the default session. The sessions sharing TT and the pools of 'batch'
+  // leave it alone, so that they do not age the entries of a running search.
+  if (pool == &Threads || pool->tt != &TT)
+      pool->tt->new_search();
+
+  pool->trace.newSearch = now_micros();
 
   if (rootMoves.empty())
   {
       rootMoves.emplace_back(MOVE_NONE);
-      sync_cout << "info depth 0 score "
-                << UCI::value(rootPos.checkers() ? -VALUE_MATE : VALUE_DRAW)
-                << sync_endl;
-  }
-  else
-  {
-      Threads.start_searching(); // start non-main threads
-      Thread::search();          // main thread start searching
+      if (!pool->quiet)
+          sync_cout << pool->label << "info depth 0 score "
+                    << UCI::value(rootPos.checkers() ? -VALUE_MATE : VALUE_DRAW)
+                    << sync_endl;
   }
+  else if (!pool->cachedResult)
+      Thread::search(); // Starts the non-main threads, see below
+
+  // Only a search that was not stopped completed its last iteration, so that
+  // its result can be cached, see ResultCache
+  const bool completed = !pool->stop;
 
   // When we reach the maximum depth, we can arrive here without a raise of
   // Threads.stop. However, if we are pondering or in an infinite search,
@@ -239,36 +252,69 @@ void MainThread::search() {
   // GUI sends a "stop" or "ponderhit" command. We therefore simply wait here
   // until the GUI sends one of those commands.
 
-  while (!Threads.stop && (ponder || Limits.infinite))
+  while (!pool->stop && (ponder || pool->limits.infinite))
   {} // Busy wait for a stop or a ponder reset
 
   // Stop the threads if not already stopped (also raise the stop if
   // "ponderhit" just reset Threads.ponder).
-  Threads.stop = true;
+  pool->stop = true;
 
   // Wait until all threads have finished
-  Threads.wait_for_search_finished();
+  pool->wait_for_search_finished();
 
   // When playing in 'nodes as time' mode, subtract the searched nodes from
   // the available ones before exiting.
-  if (Limits.npmsec)
-      Time.availableNodes += Limits.inc[us] - Threads.nodes_searched();
+  if (pool->limits.npmsec)
+      pool->time.availableNodes += pool->limits.inc[us] - pool->nodes_searched();
 
   Thread* bestThread = this;
 
   if (   int(Options["MultiPV"]) == 1
-      && !Limits.depth
+      && !pool->limits.depth
+      && !pool->mainOnly
       && !(Skill(Options["Skill Level"]).enabled() || int(Options["UCI_LimitStrength"]))
       && rootMoves[0].pv[0] != MOVE_NONE)
-      bestThread = Threads.get_best_thread();
+      bestThread = pool->get_best_thread();
 
   bestPreviousScore = bestThread->rootMoves[0].score;
+  pool->lastBest = bestThread->rootMoves[0];
+  pool->lastDepth = bestThread->completedDepth;
+
+  // Keep the keys of the root and of the positions after the first two PV
+  // moves. The next setup() compares the new root against them, as rootPos
+  // may no longer be valid by then. Playing the moves must not count as
+  // searched nodes.
+  StateInfo st[2];
+  int ply = 0;
+  const uint64_t searched = nodes;
+
+  pool->lastKeys[0] = rootPos.key();
+
+  while (ply < 2 && ply + 1 < int(pool->lastBest.pv.size()))
+  {
+      rootPos.do_move(pool->lastBest.pv[ply], st[ply]);
+      pool->lastKeys[++ply] = rootPos.key();
+  }
+
+  pool->lastPlies = ply;
+
+  while (ply > 0)
+      rootPos.undo_move(pool->lastBest.pv[--ply]);
+
+  nodes = searched;
 
-  // Send again PV info if we have a new best thread
-  if (bestThread != this)
+  if (pool->resultKey && completed && bestThread->completedDepth)
+      pool->results.store(pool->resultKey, bestThread->completedDepth, bestThread->rootMoves);
+
+  if (pool->quiet)
+      return;
+
+  // Send again PV info if we have a new best thread, or at all if we did not
+  // search because the result was cached
+  if (bestThread != this || pool->cachedResult)
       sync_cout << UCI::pv(bestThread->rootPos, bestThread->completedDepth, -VALUE_INFINITE, VALUE_INFINITE) << sync_endl;
 
-  sync_cout << "bestmove " << UCI::move(bestThread->rootMoves[0].pv[0], rootPos.is_chess960());
+  sync_cout << pool->label << "bestmove " << UCI::move(bestThread->rootMoves[0].pv[0], rootPos.is_chess960());
 
   if (bestThread->rootMoves[0].pv.size() > 1 || bestThread->rootMoves[0].extract_ponder_from_tt(rootPos))
       std::cout << " ponder " << UCI::move(bestThread->rootMoves[0].pv[1], rootPos.is_chess960());
@@ -292,14 +338,14 @@ void Thread::search() {
   Value bestValue, alpha, beta, delta;
   Move  lastBestMove = MOVE_NONE;
   Depth lastBestMoveDepth = 0;
-  MainThread* mainThread = (this == Threads.main() ? Threads.main() : nullptr);
+  MainThread* mainThread = (this == pool->main() ? pool->main() : nullptr);
   double timeReduction = 1, totBestMoveChanges = 0;
   Color us = rootPos.side_to_move();
   int iterIdx = 0;
 
   std::memset(ss-7, 0, 10 * sizeof(Stack));
   for (int i = 7; i > 0; i--)
-      (ss-i)->continuationHistory = &this->continuationHistory[0][0][NO_PIECE][0]; // Use as a sentinel
+      (ss-i)->continuationHistory = &this->continuation_history(false, false)[NO_PIECE][0]; // Use as a sentinel
 
   ss->pv = pv;
 
@@ -345,7 +391,7 @@ void Thread::search() {
   int ct = int(Options["Contempt"]) * PawnValueEg / 100; // From centipawns
 
   // In analysis mode, adjust contempt in accordance with user preference
-  if (Limits.infinite || Options["UCI_AnalyseMode"])
+  if (pool->limits.infinite || Options["UCI_AnalyseMode"])
       ct =  Options["Analysis Contempt"] == "Off"  ? 0
           : Options["Analysis Contempt"] == "Both" ? ct
           : Options["Analysis Contempt"] == "White" && us == BLACK ? -ct
@@ -358,10 +404,25 @@ void Thread::search() {
 
   int searchAgainCounter = 0;
 
+  // The main thread wakes the helper threads. Under a latency target and from
+  // depth 1 it does so after the first iteration, which takes less time than
+  // waking them, so that its info line goes out first.
+  bool helpersAsleep = mainThread && !pool->mainOnly;
+
+  auto wake_helpers = [&]() {
+      TimePoint start = now_micros();
+      pool->start_searching();
+      pool->trace.helpers = now_micros() - start;
+      helpersAsleep = false;
+  };
+
+  if (helpersAsleep && (rootDepth > 0 || !pool->limits.latency))
+      wake_helpers();
+
   // Iterative deepening loop until requested to stop or the target depth is reached
   while (   ++rootDepth < MAX_PLY
-         && !Threads.stop
-         && !(Limits.depth && mainThread && rootDepth > Limits.depth))
+         && !pool->stop
+         && !(pool->limits.depth && mainThread && rootDepth > pool->limits.depth))
   {
       // Age out PV variability metric
       if (mainThread)
@@ -375,11 +436,11 @@ void Thread::search() {
       size_t pvFirst = 0;
       pvLast = 0;
 
-      if (!Threads.increaseDepth)
+      if (!pool->increaseDepth)
          searchAgainCounter++;
 
       // MultiPV loop. We perform a full root search for each PV line
-      for (pvIdx = 0; pvIdx < multiPV && !Threads.stop; ++pvIdx)
+      for (pvIdx = 0; pvIdx < multiPV && !pool->stop; ++pvIdx)
       {
           if (pvIdx == pvLast)
           {
@@ -425,15 +486,16 @@ void Thread::search() {
               // If search has been stopped, we break immediately. Sorting is
               // safe because RootMoves is still valid, although it refers to
               // the previous iteration.
-              if (Threads.stop)
+              if (pool->stop)
                   break;
 
               // When failing high/low give some update (without cluttering
               // the UI) before a re-search.
               if (   mainThread
+                  && !pool->quiet
                   && multiPV == 1
                   && (bestValue <= alpha || bestValue >= beta)
-                  && Time.elapsed() > 3000)
+                  && pool->time.elapsed() > 3000)
                   sync_cout << UCI::pv(rootPos, rootDepth, alpha, beta) << sync_endl;
 
               // In case of failing low/high increase aspiration window and
@@ -467,34 +529,43 @@ void Thread::search() {
           std::stable_sort(rootMoves.begin() + pvFirst, rootMoves.begin() + pvIdx + 1);
 
           if (    mainThread
-              && (Threads.stop || pvIdx + 1 == multiPV || Time.elapsed() > 3000))
+              && !pool->quiet
+              && (pool->stop || pvIdx + 1 == multiPV || pool->time.elapsed() > 3000))
+          {
               sync_cout << UCI::pv(rootPos, rootDepth, alpha, beta) << sync_endl;
+
+              if (!pool->trace.firstInfo)
+                  pool->trace.firstInfo = now_micros();
+          }
       }
 
-      if (!Threads.stop)
+      if (!pool->stop)
           completedDepth = rootDepth;
 
+      if (helpersAsleep && !pool->stop)
+          wake_helpers();
+
       if (rootMoves[0].pv[0] != lastBestMove) {
          lastBestMove = rootMoves[0].pv[0];
          lastBestMoveDepth = rootDepth;
       }
 
       // Have we found a "mate in x"?
-      if (   Limits.mate
+      if (   pool->limits.mate
           && bestValue >= VALUE_MATE_IN_MAX_PLY
-          && VALUE_MATE - bestValue <= 2 * Limits.mate)
-          Threads.stop = true;
+          && VALUE_MATE - bestValue <= 2 * pool->limits.mate)
+          pool->stop = true;
 
       if (!mainThread)
           continue;
 
       // If skill level is enabled and time is up, pick a sub-optimal best move
       if (skill.enabled() && skill.time_to_pick(rootDepth))
-          skill.pick_best(multiPV);
+          skill.pick_best(rootMoves, multiPV);
 
       // Do we have time for the next iteration? Can we stop searching now?
-      if (    Limits.use_time_management()
-          && !Threads.stop
+      if (    pool->limits.use_time_management()
+          && !pool->stop
           && !mainThread->stopOnPonderhit)
       {
           double fallingEval = (296 + 6 * (mainThread->bestPreviousScore - bestValue)
@@ -506,32 +577,32 @@ void Thread::search() {
           double reduction = (1.47 + mainThread->previousTimeReduction) / (2.22 * timeReduction);
 
           // Use part of the gained time from a previous stable move for the current move
-          for (Thread* th : Threads)
+          for (Thread* th : *pool)
           {
               totBestMoveChanges += th->bestMoveChanges;
               th->bestMoveChanges = 0;
           }
-          double bestMoveInstability = 1 + totBestMoveChanges / Threads.size();
+          double bestMoveInstability = 1 + totBestMoveChanges / pool->size();
 
           double totalTime = rootMoves.size() == 1 ? 0 :
-                             Time.optimum() * fallingEval * reduction * bestMoveInstability;
+                             pool->time.optimum() * fallingEval * reduction * bestMoveInstability;
 
           // Stop the search if we have exceeded the totalTime, at least 1ms search
-          if (Time.elapsed() > totalTime)
+          if (pool->time.elapsed() > totalTime)
           {
               // If we are allowed to ponder do not stop the search now but
               // keep pondering until the GUI sends "ponderhit" or "stop".
               if (mainThread->ponder)
                   mainThread->stopOnPonderhit = true;
               else
-                  Threads.stop = true;
+                  pool->stop = true;
           }
-          else if (   Threads.increaseDepth
+          else if (   pool->increaseDepth
                    && !mainThread->ponder
-                   && Time.elapsed() > totalTime * 0.56)
-                   Threads.increaseDepth = false;
+                   && pool->time.elapsed() > totalTime * 0.56)
+                   pool->increaseDepth = false;
           else
-                   Threads.increaseDepth = true;
+                   pool->increaseDepth = true;
       }
 
       mainThread->iterValue[iterIdx] = bestValue;
@@ -546,7 +617,7 @@ void Thread::search() {
   // If skill level is enabled, swap best PV line with the sub-optimal one
   if (skill.enabled())
       std::swap(rootMoves[0], *std::find(rootMoves.begin(), rootMoves.end(),
-                skill.best ? skill.best : skill.pick_best(multiPV)));
+                skill.best ? skill.best : skill.pick_best(rootMoves, multiPV)));
 }
 
 
@@ -584,6 +655,7 @@ namespace {
     Move pv[MAX_PLY+1], capturesSearched[32], quietsSearched[64];
     StateInfo st;
     TTEntry* tte;
+    TTEntry ttData; // Verified copy of *tte
     Key posKey;
     Move ttMove, move, excludedMove, bestMove;
     Depth extension, newDepth;
@@ -596,6 +668,7 @@ namespace {
 
     // Step 1. Initialize node
     Thread* thisThread = pos.this_thread();
+    TranspositionTable* tt = thisThread->pool->tt;
     ss->inCheck = pos.checkers();
     priorCapture = pos.captured_piece();
     Color us = pos.side_to_move();
@@ -604,7 +677,7 @@ namespace {
     maxValue = VALUE_INFINITE;
 
     // Check for the available remaining time
-    if (thisThread == Threads.main())
+    if (thisThread == thisThread->pool->main())
         static_cast<MainThread*>(thisThread)->check_time();
 
     // Used to send selDepth info to GUI (selDepth counts from 1, ply from 0)
@@ -614,7 +687,7 @@ namespace {
     if (!rootNode)
     {
         // Step 2. Check for aborted search and immediate draw
-        if (   Threads.stop.load(std::memory_order_relaxed)
+        if (   thisThread->pool->stop.load(std::memory_order_relaxed)
             || pos.is_draw(ss->ply)
             || ss->ply >= MAX_PLY)
             return (ss->ply >= MAX_PLY && !ss->inCheck) ? evaluate(pos)
@@ -654,11 +727,11 @@ namespace {
     // position key in case of an excluded move.
     excludedMove = ss->excludedMove;
     posKey = excludedMove == MOVE_NONE ? pos.key() : pos.key() ^ make_key(excludedMove);
-    tte = TT.probe(posKey, ttHit);
-    ttValue = ttHit ? value_from_tt(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
+    tte = tt->probe(posKey, ttHit, ttData);
+    ttValue = ttHit ? value_from_tt(ttData.value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
     ttMove =  rootNode ? thisThread->rootMoves[thisThread->pvIdx].pv[0]
-            : ttHit    ? tte->move() : MOVE_NONE;
-    ttPv = PvNode || (ttHit && tte->is_pv());
+            : ttHit    ? ttData.move() : MOVE_NONE;
+    ttPv = PvNode || (ttHit && ttData.is_pv());
     formerPv = ttPv && !PvNode;
 
     if (   ttPv
@@ -675,10 +748,10 @@ namespace {
     // At non-PV nodes we check for an early TT cutoff
     if (  !PvNode
         && ttHit
-        && tte->depth() >= depth
+        && ttData.depth() >= depth
         && ttValue != VALUE_NONE // Possible in case of TT access race
-        && (ttValue >= beta ? (tte->bound() & BOUND_LOWER)
-                            : (tte->bound() & BOUND_UPPER)))
+        && (ttValue >= beta ? (ttData.bound() & BOUND_LOWER)
+                            : (ttData.bound() & BOUND_UPPER)))
     {
         // If ttMove is quiet, update move sorting heuristics on TT hit
         if (ttMove)
@@ -720,7 +793,7 @@ namespace {
     else if (ttHit)
     {
         // Never assume anything about values stored in TT
-        ss->staticEval = eval = tte->eval();
+        ss->staticEval = eval = ttData.eval();
         if (eval == VALUE_NONE)
             ss->staticEval = eval = evaluate(pos);
 
@@ -729,7 +802,7 @@ namespace {
 
         // Can ttValue be used as a better position evaluation?
         if (    ttValue != VALUE_NONE
-            && (tte->bound() & (ttValue > eval ? BOUND_LOWER : BOUND_UPPER)))
+            && (ttData.bound() & (ttValue > eval ? BOUND_LOWER : BOUND_UPPER)))
             eval = ttValue;
     }
     else
@@ -743,7 +816,8 @@ namespace {
         else
             ss->staticEval = eval = -(ss-1)->staticEval + 2 * Tempo;
 
-        tte->save(posKey, VALUE_NONE, ttPv, BOUND_NONE, DEPTH_NONE, MOVE_NONE, eval);
+        tte->save(posKey, VALUE_NONE, ttPv, BOUND_NONE, DEPTH_NONE, MOVE_NONE, eval,
+                  tt->generation(), tt->statistics());
     }
 
     // Step 7. Razoring (~1 Elo)
@@ -779,7 +853,7 @@ namespace {
         Depth R = (737 + 77 * depth) / 246 + std::min(int(eval - beta) / 192, 3);
 
         ss->currentMove = MOVE_NULL;
-        ss->continuationHistory = &thisThread->continuationHistory[0][0][NO_PIECE][0];
+        ss->continuationHistory = &thisThread->continuation_history(false, false)[NO_PIECE][0];
 
         pos.do_null_move(st);
 
@@ -821,12 +895,12 @@ namespace {
         &&  depth > 4
         &&  abs(beta) < VALUE_TB_WIN_IN_MAX_PLY
         && !(   ttHit
-             && tte->depth() >= depth - 3
+             && ttData.depth() >= depth - 3
              && ttValue != VALUE_NONE
              && ttValue < probcutBeta))
     {
         if (   ttHit
-            && tte->depth() >= depth - 3
+            && ttData.depth() >= depth - 3
             && ttValue != VALUE_NONE
             && ttValue >= probcutBeta
             && ttMove
@@ -848,10 +922,9 @@ namespace {
                 probCutCount++;
 
                 ss->currentMove = move;
-                ss->continuationHistory = &thisThread->continuationHistory[ss->inCheck]
-                                                                          [captureOrPromotion]
-                                                                          [pos.moved_piece(move)]
-                                                                          [to_sq(move)];
+                ss->continuationHistory = &thisThread->continuation_history(ss->inCheck, captureOrPromotion)
+                                                                           [pos.moved_piece(move)]
+                                                                           [to_sq(move)];
 
                 pos.do_move(move, st);
 
@@ -867,11 +940,12 @@ namespace {
                 if (value >= probcutBeta)
                 {
                     if ( !(ttHit
-                       && tte->depth() >= depth - 3
+                       && ttData.depth() >= depth - 3
                        && ttValue != VALUE_NONE))
                         tte->save(posKey, value_to_tt(value, ss->ply), ttPv,
                             BOUND_LOWER,
-                            depth - 3, move, ss->staticEval);
+                            depth - 3, move, ss->staticEval,
+                            tt->generation(), tt->statistics());
                     return value;
                 }
             }
@@ -882,9 +956,9 @@ namespace {
     {
         search<NT>(pos, ss, alpha, beta, depth - 7, cutNode);
 
-        tte = TT.probe(posKey, ttHit);
-        ttValue = ttHit ? value_from_tt(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
-        ttMove = ttHit ? tte->move() : MOVE_NONE;
+        tte = tt->probe(posKey, ttHit, ttData);
+        ttValue = ttHit ? value_from_tt(ttData.value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
+        ttMove = ttHit ? ttData.move() : MOVE_NONE;
     }
 
 moves_loop: // When in check, search starts from here
@@ -929,8 +1003,11 @@ moves_loop: // When in check, search starts from here
 
       ss->moveCount = ++moveCount;
 
-      if (rootNode && thisThread == Threads.main() && Time.elapsed() > 3000)
-          sync_cout << "info depth " << depth
+      if (   rootNode
+          && thisThread == thisThread->pool->main()
+          && !thisThread->pool->quiet
+          && thisThread->pool->time.elapsed() > 3000)
+          sync_cout << thisThread->pool->label << "info depth " << depth
                     << " currmove " << UCI::move(move, pos.is_chess960())
                     << " currmovenumber " << moveCount + thisThread->pvIdx << sync_endl;
       if (PvNode)
@@ -1015,8 +1092,8 @@ moves_loop: // When in check, search starts from here
           && !excludedMove // Avoid recursive singular search
        /* &&  ttValue != VALUE_NONE Already implicit in the next condition */
           &&  abs(ttValue) < VALUE_KNOWN_WIN
-          && (tte->bound() & BOUND_LOWER)
-          &&  tte->depth() >= depth - 3
+          && (ttData.bound() & BOUND_LOWER)
+          &&  ttData.depth() >= depth - 3
           &&  pos.legal(move))
       {
           Value singularBeta = ttValue - ((formerPv + 4) * depth) / 2;
@@ -1076,7 +1153,7 @@ moves_loop: // When in check, search starts from here
       newDepth += extension;
 
       // Speculative prefetch as early as possible
-      prefetch(TT.first_entry(pos.key_after(move)));
+      prefetch(tt->first_entry(pos.key_after(move)));
 
       // Check for legality just before making the move
       if (!rootNode && !pos.legal(move))
@@ -1087,10 +1164,9 @@ moves_loop: // When in check, search starts from here
 
       // Update the current move (this must be done after singular extension search)
       ss->currentMove = move;
-      ss->continuationHistory = &thisThread->continuationHistory[ss->inCheck]
-                                                                [captureOrPromotion]
-                                                                [movedPiece]
-                                                                [to_sq(move)];
+      ss->continuationHistory = &thisThread->continuation_history(ss->inCheck, captureOrPromotion)
+                                                                 [movedPiece]
+                                                                 [to_sq(move)];
 
       // Step 15. Make the move
       pos.do_move(move, st, givesCheck);
@@ -1235,7 +1311,7 @@ moves_loop: // When in check, search starts from here
       // Finished searching the move. If a stop occurred, the return value of
       // the search cannot be trusted, and we return immediately without
       // updating best move, PV and TT.
-      if (Threads.stop.load(std::memory_order_relaxed))
+      if (thisThread->pool->stop.load(std::memory_order_relaxed))
           return VALUE_ZERO;
 
       if (rootNode)
@@ -1304,7 +1380,7 @@ moves_loop: // When in check, search starts from here
     // completed. But in this case bestValue is valid because we have fully
     // searched our subtree, and we can anyhow save the result in TT.
     /*
-       if (Threads.stop)
+       if (thisThread->pool->stop)
         return VALUE_DRAW;
     */
 
@@ -1335,7 +1411,7 @@ moves_loop: // When in check, search starts from here
         tte->save(posKey, value_to_tt(bestValue, ss->ply), ttPv,
                   bestValue >= beta ? BOUND_LOWER :
                   PvNode && bestMove ? BOUND_EXACT : BOUND_UPPER,
-                  depth, bestMove, ss->staticEval);
+                  depth, bestMove, ss->staticEval, tt->generation(), tt->statistics());
 
     assert(bestValue > -VALUE_INFINITE && bestValue < VALUE_INFINITE);
 
@@ -1357,6 +1433,7 @@ moves_loop: // When in check, search starts from here
     Move pv[MAX_PLY+1];
     StateInfo st;
     TTEntry* tte;
+    TTEntry ttData; // Verified copy of *tte
     Key posKey;
     Move ttMove, move, bestMove;
     Depth ttDepth;
@@ -1372,6 +1449,7 @@ moves_loop: // When in check, search starts from here
     }
 
     Thread* thisThread = pos.this_thread();
+    TranspositionTable* tt = thisThread->pool->tt;
     (ss+1)->ply = ss->ply + 1;
     bestMove = MOVE_NONE;
     ss->inCheck = pos.checkers();
@@ -1391,17 +1469,17 @@ moves_loop: // When in check, search starts from here
                                                   : DEPTH_QS_NO_CHECKS;
     // Transposition table lookup
     posKey = pos.key();
-    tte = TT.probe(posKey, ttHit);
-    ttValue = ttHit ? value_from_tt(tte->value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
-    ttMove = ttHit ? tte->move() : MOVE_NONE;
-    pvHit = ttHit && tte->is_pv();
+    tte = tt->probe(posKey, ttHit, ttData);
+    ttValue = ttHit ? value_from_tt(ttData.value(), ss->ply, pos.rule50_count()) : VALUE_NONE;
+    ttMove = ttHit ? ttData.move() : MOVE_NONE;
+    pvHit = ttHit && ttData.is_pv();
 
     if (  !PvNode
         && ttHit
-        && tte->depth() >= ttDepth
+        && ttData.depth() >= ttDepth
         && ttValue != VALUE_NONE // Only in case of TT access race
-        && (ttValue >= beta ? (tte->bound() & BOUND_LOWER)
-                            : (tte->bound() & BOUND_UPPER)))
+        && (ttValue >= beta ? (ttData.bound() & BOUND_LOWER)
+                            : (ttData.bound() & BOUND_UPPER)))
         return ttValue;
 
     // Evaluate the position statically
@@ -1415,12 +1493,12 @@ moves_loop: // When in check, search starts from here
         if (ttHit)
         {
             // Never assume anything about values stored in TT
-            if ((ss->staticEval = bestValue = tte->eval()) == VALUE_NONE)
+            if ((ss->staticEval = bestValue = ttData.eval()) == VALUE_NONE)
                 ss->staticEval = bestValue = evaluate(pos);
 
             // Can ttValue be used as a better position evaluation?
             if (    ttValue != VALUE_NONE
-                && (tte->bound() & (ttValue > bestValue ? BOUND_LOWER : BOUND_UPPER)))
+                && (ttData.bound() & (ttValue > bestValue ? BOUND_LOWER : BOUND_UPPER)))
                 bestValue = ttValue;
         }
         else
@@ -1433,7 +1511,8 @@ moves_loop: // When in check, search starts from here
         {
             if (!ttHit)
                 tte->save(posKey, value_to_tt(bestValue, ss->ply), false, BOUND_LOWER,
-                          DEPTH_NONE, MOVE_NONE, ss->staticEval);
+                          DEPTH_NONE, MOVE_NONE, ss->staticEval,
+                          tt->generation(), tt->statistics());
 
             return bestValue;
         }
@@ -1495,7 +1574,7 @@ moves_loop: // When in check, search starts from here
           continue;
 
       // Speculative prefetch as early as possible
-      prefetch(TT.first_entry(pos.key_after(move)));
+      prefetch(tt->first_entry(pos.key_after(move)));
 
       // Check for legality just before making the move
       if (!pos.legal(move))
@@ -1505,10 +1584,9 @@ moves_loop: // When in check, search starts from here
       }
 
       ss->currentMove = move;
-      ss->continuationHistory = &thisThread->continuationHistory[ss->inCheck]
-                                                                [captureOrPromotion]
-                                                                [pos.moved_piece(move)]
-                                                                [to_sq(move)];
+      ss->continuationHistory = &thisThread->continuation_history(ss->inCheck, captureOrPromotion)
+                                                                 [pos.moved_piece(move)]
+                                                                 [to_sq(move)];
 
       // Make and search the move
       pos.do_move(move, st, givesCheck);
@@ -1545,7 +1623,7 @@ moves_loop: // When in check, search starts from here
     tte->save(posKey, value_to_tt(bestValue, ss->ply), pvHit,
               bestValue >= beta ? BOUND_LOWER :
               PvNode && bestValue > oldAlpha  ? BOUND_EXACT : BOUND_UPPER,
-              ttDepth, bestMove, ss->staticEval);
+              ttDepth, bestMove, ss->staticEval, tt->generation(), tt->statistics());
 
     assert(bestValue > -VALUE_INFINITE && bestValue < VALUE_INFINITE);
 
@@ -1698,9 +1776,8 @@ moves_loop: // When in check, search starts from here
   // When playing with strength handicap, choose best move among a set of RootMoves
   // using a statistical rule dependent on 'level'. Idea by Heinz van Saanen.
 
-  Move Skill::pick_best(size_t multiPV) {
+  Move Skill::pick_best(const RootMoves& rootMoves, size_t multiPV) {
 
-    const RootMoves& rootMoves = Threads.main()->rootMoves;
     static PRNG rng(now()); // PRNG sequence should be non-deterministic
 
     // RootMoves are already sorted by score in descending order
@@ -1739,13 +1816,16 @@ void MainThread::check_time() {
   if (--callsCnt > 0)
       return;
 
-  // When using nodes, ensure checking rate is not lower than 0.1% of nodes
-  callsCnt = Limits.nodes ? std::min(1024, int(Limits.nodes / 1024)) : 1024;
+  // When using nodes, ensure checking rate is not lower than 0.1% of nodes.
+  // With a latency target check about every 0.1 ms, as 1 ms is all we have
+  // between noticing the deadline and missing it.
+  callsCnt = pool->limits.nodes   ? std::min(1024, int(pool->limits.nodes / 1024))
+           : pool->limits.latency ? 128 : 1024;
 
   static TimePoint lastInfoTime = now();
 
-  TimePoint elapsed = Time.elapsed();
-  TimePoint tick = Limits.startTime + elapsed;
+  TimePoint elapsed = pool->time.elapsed();
+  TimePoint tick = pool->limits.startTime + elapsed;
 
   if (tick - lastInfoTime >= 1000)
   {
@@ -1757,10 +1837,12 @@ void MainThread::check_time() {
   if (ponder)
       return;
 
-  if (   (Limits.use_time_management() && (elapsed > Time.maximum() - 10 || stopOnPonderhit))
-      || (Limits.movetime && elapsed >= Limits.movetime)
-      || (Limits.nodes && Threads.nodes_searched() >= (uint64_t)Limits.nodes))
-      Threads.stop = true;
+  if (   (pool->limits.use_time_management() && (elapsed > pool->time.maximum() - 10 || stopOnPonderhit))
+      || (pool->limits.movetime && elapsed >= pool->limits.movetime)
+      || (pool->limits.latency && elapsed >= pool->limits.latency - 1)
+      || (pool->limits.nodes && pool->nodes_searched() >= (uint64_t)pool->limits.nodes)
+      || pool->lender_stopped()) // Of a borrowed thread, e.g. on 'stop' during 'batch'
+      pool->stop = true;
 }
 
 
@@ -1770,11 +1852,12 @@ void MainThread::check_time() {
 string UCI::pv(const Position& pos, Depth depth, Value alpha, Value beta) {
 
   std::stringstream ss;
-  long elapsed = std::max((long)Time.elapsed(), 1L); // Avoid divide by zero
+  const ThreadPool& pool = *pos.this_thread()->pool;
+  long elapsed = std::max((long)pool.time.elapsed(), 1L); // Avoid divide by zero
   const RootMoves& rootMoves = pos.this_thread()->rootMoves;
   size_t pvIdx = pos.this_thread()->pvIdx;
   size_t multiPV = std::min((size_t)Options["MultiPV"], rootMoves.size());
-  uint64_t nodesSearched = Threads.nodes_searched();
+  uint64_t nodesSearched = pool.nodes_searched();
 
   for (size_t i = 0; i < multiPV; ++i)
   {
@@ -1789,7 +1872,7 @@ string UCI::pv(const Position& pos, Depth depth, Value alpha, Value beta) {
       if (ss.rdbuf()->in_avail()) // Not at first line
           ss << "\n";
 
-      ss << "info"
+      ss << pool.label << "info"
          << " depth "    << d
          << " seldepth " << rootMoves[i].selDepth
          << " multipv "  << i + 1
@@ -1805,7 +1888,7 @@ string UCI::pv(const Position& pos, Depth depth, Value alpha, Value beta) {
          << " nps "      << nodesSearched * 1000 / elapsed;
 
       if (elapsed > 1000) // Earlier makes little sense
-          ss << " hashfull " << TT.hashfull();
+          ss << " hashfull " << pool.tt->hashfull();
 
       ss << " time "     << elapsed
          << " pv";
@@ -1834,11 +1917,12 @@ bool RootMove::extract_ponder_from_tt(Position& pos) {
         return false;
 
     pos.do_move(pv[0], st);
-    TTEntry* tte = TT.probe(pos.key(), ttHit);
+    TTEntry ttData;
+    pos.this_thread()->pool->tt->probe(pos.key(), ttHit, ttData);
 
     if (ttHit)
     {
-        Move m = tte->move(); // Local copy to be SMP safe
+        Move m = ttData.move();
         if (MoveList<LEGAL>(pos).contains(m))
             pv.push_back(m);
     }
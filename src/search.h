@@ -83,7 +83,8 @@ typedef std::vector<RootMove> RootMoves;
 struct LimitsType {
 
   LimitsType() { // Init explicitly due to broken value-initialization of non POD in MSVC
-    time[WHITE] = time[BLACK] = inc[WHITE] = inc[BLACK] = npmsec = movetime = TimePoint(0);
+    time[WHITE] = time[BLACK] = inc[WHITE] = inc[BLACK] = npmsec = movetime = latency = TimePoint(0);
+    startMicros = TimePoint(0);
     movestogo = depth = mate = perft = infinite = 0;
     nodes = 0;
   }
@@ -93,15 +94,14 @@ struct LimitsType {
   }
 
   std::vector<Move> searchmoves;
-  TimePoint time[COLOR_NB], inc[COLOR_NB], npmsec, movetime, startTime;
+  TimePoint time[COLOR_NB], inc[COLOR_NB], npmsec, movetime, latency, startTime;
+  TimePoint startMicros; // Of the 'go' command, for ThreadPool::latency()
   int movestogo, depth, mate, perft, infinite;
   int64_t nodes;
 };
 
-extern LimitsType Limits;
-
 void init();
-void clear();
+void clear(bool sharedHash = false);
 
 } // namespace Search
 
@@ -21,6 +21,9 @@
 #include <cassert>
 
 #include <algorithm> // For std::count
+#include <iomanip>
+#include <sstream>
+
 #include "movegen.h"
 #include "search.h"
 #include "thread.h"
@@ -33,7 +36,7 @@ ThreadPool Threads; // Global object
 /// Thread constructor launches the thread and waits until it goes to sleep
 /// in idle_loop(). Note that 'searching' and 'exit' should be already set.
 
-Thread::Thread(size_t n) : idx(n), stdThread(&Thread::idle_loop, this) {
+Thread::Thread(size_t n, ThreadPool* p) : idx(n), pool(p), stdThread(&Thread::idle_loop, this) {
 
   // (A) Upstream does wait_for_search_finished() directly here.
   //
@@ -44,8 +47,9 @@ Thread::Thread(size_t n) : idx(n), stdThread(&Thread::idle_loop, this) {
   //
   // https://bugzilla.mozilla.org/show_bug.cgi?id=1049079
   //
-  // Instead we introduced threadStarted (B) and retry uci_command with
-  // exponential backoff until all threads have started.
+  // Instead we introduced threadStarted (B). uci_command refuses to run
+  // while a thread is still starting, and UCI::mailbox_loop(), which runs on
+  // a thread of its own, waits in wait_for_start() before each command.
 }
 
 
@@ -85,10 +89,14 @@ void Thread::clear() {
   for (bool inCheck : { false, true })
       for (StatsType c : { NoCaptures, Captures })
       {
-          for (auto& to : continuationHistory[inCheck][c])
+#ifdef COMPACT_HISTORY
+          if (inCheck && this != pool->main())
+              continue; // Shared, cleared once by the main thread
+#endif
+          for (auto& to : continuation_history(inCheck, c))
                 for (auto& h : to)
                       h->fill(0);
-          continuationHistory[inCheck][c][NO_PIECE][0]->fill(Search::CounterMovePruneThreshold - 1);
+          continuation_history(inCheck, c)[NO_PIECE][0]->fill(Search::CounterMovePruneThreshold - 1);
       }
 }
 
@@ -103,6 +111,19 @@ void Thread::start_searching() {
 }
 
 
+/// Thread::run_custom_job() wakes up the thread to run the given function
+/// instead of a search. As with a search, completion can be awaited with
+/// wait_for_search_finished().
+
+void Thread::run_custom_job(std::function<void()> f) {
+
+  std::lock_guard<std::mutex> lk(mutex);
+  jobFunc = std::move(f);
+  searching = true;
+  cv.notify_one(); // Wake up the thread in idle_loop()
+}
+
+
 /// Thread::wait_for_search_finished() blocks on the condition variable
 /// until the thread has finished searching.
 
@@ -113,6 +134,26 @@ void Thread::wait_for_search_finished() {
 }
 
 
+/// Thread::is_searching() tells whether the thread is busy with a search or a
+/// custom job, without waiting for it.
+
+bool Thread::is_searching() {
+
+  std::lock_guard<std::mutex> lk(mutex);
+  return searching;
+}
+
+
+/// Thread::wait_for_start() blocks until the thread has reached idle_loop().
+/// In the wasm build it must not be called from the browser thread, see (A).
+
+void Thread::wait_for_start() {
+
+  std::unique_lock<std::mutex> lk(mutex);
+  cv.wait(lk, [&]{ return bool(threadStarted); });
+}
+
+
 /// Thread::idle_loop() is where the thread is parked, blocked on the
 /// condition variable, when it has no work to do.
 
@@ -122,6 +163,7 @@ void Thread::idle_loop() {
   {
       std::unique_lock<std::mutex> lk(mutex);
       searching = false;
+
       threadStarted = true; // (B)
 
       cv.notify_one(); // Wake up anyone waiting for search finished
@@ -132,7 +174,17 @@ void Thread::idle_loop() {
 
       lk.unlock();
 
-      search();
+      if (jobFunc)
+      {
+          jobFunc();
+          jobFunc = nullptr;
+      }
+      // Every thread is a MainThread, see ThreadPool::set(), but only the
+      // first one of its pool runs the main thread search
+      else if (this == pool->main())
+          search();
+      else
+          Thread::search();
   }
 }
 
@@ -142,7 +194,9 @@ void Thread::idle_loop() {
 ///
 /// stockfish.wasm: Unlike upstream, we reuse existing threads, because
 /// we do not care about thread binding. For the same reason, we also do not
-/// reallocate the transposition table.
+/// reallocate the transposition table, and only clear the pool when it is
+/// first populated. All threads are created as MainThread, so that any of
+/// them can search on its own for another pool, see borrow().
 
 void ThreadPool::set(size_t requested) {
 
@@ -157,16 +211,259 @@ void ThreadPool::set(size_t requested) {
   }
 
   if (requested > 0) {
+      const size_t oldSize = size();
+
       while (size() < requested)
-          push_back(size() ? new Thread(size()) : new MainThread(0));
-      clear();
+          push_back(new MainThread(size(), this));
+
+#ifdef COMPACT_HISTORY
+      if (!checkHistory)
+          checkHistory.reset(new ContinuationHistory[2]);
+
+      for (Thread* th : *this)
+          th->checkHistory = checkHistory.get();
+#endif
+
+      resize_tables();
+
+      // Only new threads start from scratch, so that changing the number of
+      // threads keeps the histories and the results of the session.
+      if (!oldSize)
+          clear();
+      else
+          for (size_t idx = oldSize; idx < size(); ++idx)
+              (*this)[idx]->clear();
+
+      // Init thread number dependent search params. These are shared by all
+      // sessions and follow the default one.
+      if (this == &Threads)
+          Search::init();
+  }
+}
+
+
+/// ThreadPool::resize_tables() sizes the pawn and material hash tables of our
+/// threads as set by the 'Pawn Hash' and 'Material Hash' options, in KB.
+
+void ThreadPool::resize_tables() {
+
+  main()->wait_for_search_finished();
 
-      // Init thread number dependent search params.
-      Search::init();
+  for (Thread* th : *this)
+  {
+      th->pawnsTable.resize(size_t(Options["Pawn Hash"]));
+      th->materialTable.resize(size_t(Options["Material Hash"]));
   }
 }
 
 
+/// ThreadPool::borrow() makes an idle thread of another pool the only thread of
+/// this one, so that it can run a search of its own without creating a new
+/// thread. It keeps its histories. give_back() returns it to its pool.
+
+void ThreadPool::borrow(Thread* th) {
+
+  assert(empty() && th->threadStarted);
+
+  th->wait_for_search_finished();
+  lender = th->pool;
+  th->pool = this;
+  push_back(th);
+
+  main()->callsCnt = 0;
+  main()->bestPreviousScore = VALUE_INFINITE;
+  main()->previousTimeReduction = 1.0;
+  lastDepth = 0;
+}
+
+void ThreadPool::give_back() {
+
+  main()->wait_for_search_finished();
+  main()->pool = lender;
+  pop_back();
+  lastDepth = 0;
+}
+
+
+/// ThreadPool::memory() returns a report of the memory used by the threads for
+/// the 'memory' debug command. The pawn and material tables live on the heap
+/// and are not part of sizeof(Thread). Their hit rates are summed over the
+/// threads since the tables were last resized, if compiled with HASH_STATS.
+
+std::string ThreadPool::memory() const {
+
+  const Thread& th = *main();
+  const size_t tables = th.pawnsTable.bytes() + th.materialTable.bytes();
+  const size_t perThread = sizeof(MainThread) + tables;
+  size_t shared = 0;
+
+#ifdef COMPACT_HISTORY
+  shared = 2 * sizeof(ContinuationHistory);
+#endif
+
+  std::stringstream ss;
+
+  auto line = [&](const char* name, size_t bytes) {
+      ss << name << std::setw(8) << bytes / 1024 << " KB\n";
+  };
+
+  line("Continuation history  : ", sizeof(th.continuationHistory));
+  line("Main history          : ", sizeof(th.mainHistory));
+  line("Low ply history       : ", sizeof(th.lowPlyHistory));
+  line("Capture history       : ", sizeof(th.captureHistory));
+  line("Counter moves         : ", sizeof(th.counterMoves));
+  line("Pawns table           : ", th.pawnsTable.bytes());
+  line("Material table        : ", th.materialTable.bytes());
+  line("Other                 : ", sizeof(MainThread) - sizeof(th.continuationHistory)
+                                   - sizeof(th.mainHistory) - sizeof(th.lowPlyHistory)
+                                   - sizeof(th.captureHistory) - sizeof(th.counterMoves));
+  line("Per thread            : ", perThread);
+  line("Shared check history  : ", shared);
+
+#ifdef HASH_STATS
+  auto hits = [&](const char* name, uint64_t probes, uint64_t hitCount) {
+      ss << name << std::fixed << std::setprecision(2)
+         << (probes ? 100.0 * hitCount / probes : 0.0) << "% of " << probes << " probes\n";
+  };
+
+  uint64_t pawnProbes = 0, pawnHits = 0, materialProbes = 0, materialHits = 0;
+
+  for (const Thread* t : *this)
+  {
+      pawnProbes += t->pawnsTable.probes;
+      pawnHits += t->pawnsTable.hits;
+      materialProbes += t->materialTable.probes;
+      materialHits += t->materialTable.hits;
+  }
+
+  hits("Pawns table hits      : ", pawnProbes, pawnHits);
+  hits("Material table hits   : ", materialProbes, materialHits);
+#else
+  ss << "Table hits            : not counted, build with hashstats=yes\n";
+#endif
+
+  ss << "Threads " << size() << ", total" << std::setw(10)
+     << (size() * perThread + shared) / 1024 << " KB, hash "
+     << tt->bytes() / (1024 * 1024) << " MB";
+
+  return ss.str();
+}
+
+
+/// ResultCache::probe() returns the result stored for the given key, if any,
+/// and makes it the most recently used.
+
+const ResultCache::Result* ResultCache::probe(Key key) {
+
+  if (!capacity)
+      return nullptr;
+
+  ++probes;
+  auto it = index.find(key);
+
+  if (it == index.end())
+      return nullptr;
+
+  ++hits;
+  lru.splice(lru.begin(), lru, it->second);
+  return &lru.front();
+}
+
+
+/// ResultCache::store() saves the result of a completed search. A result that
+/// is already stored is replaced, unless it is deeper.
+
+void ResultCache::store(Key key, Depth depth, const Search::RootMoves& rootMoves) {
+
+  if (!capacity)
+      return;
+
+  auto it = index.find(key);
+
+  if (it != index.end())
+  {
+      lru.splice(lru.begin(), lru, it->second);
+
+      if (depth < lru.front().depth)
+          return;
+
+      lru.front().depth = depth;
+      lru.front().rootMoves = rootMoves;
+      return;
+  }
+
+  lru.push_front(Result{ key, depth, rootMoves });
+  index[key] = lru.begin();
+  resize(capacity);
+}
+
+
+/// ResultCache::resize() sets the capacity and drops the least recently used
+/// results that no longer fit.
+
+void ResultCache::resize(size_t entries) {
+
+  capacity = entries;
+
+  while (lru.size() > capacity)
+  {
+      index.erase(lru.back().key);
+      lru.pop_back();
+  }
+}
+
+
+void ResultCache::clear() {
+
+  lru.clear();
+  index.clear();
+  probes = hits = 0;
+}
+
+
+/// ResultCache::stats() returns the fill and the hit rate of the cache for the
+/// 'cache' debug command.
+
+std::string ResultCache::stats() const {
+
+  std::stringstream ss;
+
+  ss << std::fixed << std::setprecision(2)
+     << "Results : " << lru.size() << " of " << capacity
+     << "\nHits    : " << hits << " of " << probes << " probes ("
+     << (probes ? 100.0 * hits / probes : 0.0) << "%)";
+
+  return ss.str();
+}
+
+
+/// ThreadPool::latency() returns the time taken by each step from receiving
+/// the last 'go' to its first info line, for the 'latency' debug command. The
+/// steps up to the setup run on the thread that received 'go', the others on
+/// the main thread, so in wasm the wake-up time also absorbs the clock offset
+/// between the two threads.
+
+std::string ThreadPool::latency() const {
+
+  std::stringstream ss;
+  const GoTrace& t = trace;
+
+  auto line = [&](const char* name, TimePoint from, TimePoint to) {
+      ss << name << std::setw(8) << (from && to ? to - from : 0) << " us\n";
+  };
+
+  line("Root moves      : ", t.received,  t.rootMoves);
+  line("Thread setup    : ", t.rootMoves, t.setup);
+  line("Main thread wake: ", t.setup,     t.mainStart);
+  line("New search      : ", t.mainStart, t.newSearch);
+  line("Depth 1 search  : ", t.newSearch, t.firstInfo);
+  line("Total           : ", t.received,  t.firstInfo);
+  ss << "Helpers woken in " << t.helpers << " us";
+
+  return ss.str();
+}
+
+
 /// ThreadPool::clear() sets threadPool data to initial values
 
 void ThreadPool::clear() {
@@ -174,6 +471,9 @@ void ThreadPool::clear() {
   for (Thread* th : *this)
       th->clear();
 
+  lastDepth = 0;
+  results.clear();
+
   main()->callsCnt = 0;
   main()->bestPreviousScore = VALUE_INFINITE;
   main()->previousTimeReduction = 1.0;
@@ -184,14 +484,78 @@ void ThreadPool::clear() {
 /// returns immediately. Main thread will wake up other threads and start the search.
 
 void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
-                                const Search::LimitsType& limits, bool ponderMode) {
+                                const Search::LimitsType& searchLimits, bool ponderMode) {
 
   main()->wait_for_search_finished();
+  setup(pos, states, searchLimits, ponderMode);
+  main()->start_searching();
+}
+
+
+namespace {
+
+  // result_key() mixes into the key of the root position its history, as a
+  // repetition or the 50-move rule can change the result, and the limits and
+  // options other than the depth that shape the result of a search.
+
+  Key result_key(const Position& pos, const Search::LimitsType& limits) {
+
+    Key key = pos.key();
+    auto mix = [&](uint64_t v) { key = (key ^ v) * 0x9E3779B97F4A7C15ULL; };
+
+    mix(pos.history_key());
+    mix(int(Options["MultiPV"]));
+    mix(uint64_t(int(Options["Contempt"])));
+    mix(  Options["Analysis Contempt"] == "Off"   ? 0
+        : Options["Analysis Contempt"] == "White" ? 1
+        : Options["Analysis Contempt"] == "Black" ? 2 : 3);
+    mix(bool(Options["UCI_AnalyseMode"]) + 2 * bool(limits.infinite));
+
+    for (Move m : limits.searchmoves)
+        mix(m);
+
+    return key ? key : 1; // 0 is for no caching
+  }
+
+
+  // seed() prepares rootMoves to continue from 'best', the best root move of a
+  // search to 'depth' of the position 'ply' moves up its PV. The next move of
+  // the PV goes first, with the rest of the PV and its expected score. It
+  // returns the depth iterative deepening should start from: it skips the
+  // first iterations, which the TT entries of that search would answer anyway.
+
+  Depth seed(Search::RootMoves& rootMoves, const Search::RootMove& best, Depth depth, int ply) {
+
+    auto rm = std::find(rootMoves.begin(), rootMoves.end(), best.pv[ply]);
+
+    if (rm == rootMoves.end())
+        return 0;
+
+    rm->pv.assign(best.pv.begin() + ply, best.pv.end());
+    rm->score = ply % 2 ? -best.score : best.score;
+    std::rotate(rootMoves.begin(), rm, rm + 1);
+
+    return std::max(0, depth - ply - 3);
+  }
+
+} // namespace
+
+
+/// ThreadPool::setup() prepares the threads for a search of the given position.
+/// The caller is responsible for running MainThread::search().
+
+void ThreadPool::setup(Position& pos, StateListPtr& states,
+                       const Search::LimitsType& searchLimits, bool ponderMode) {
 
   main()->stopOnPonderhit = stop = false;
   increaseDepth = true;
   main()->ponder = ponderMode;
-  Search::Limits = limits;
+  limits = searchLimits;
+
+  // Only now that the last search is over, the main thread no longer writes to
+  // the trace of the last 'go'
+  trace = GoTrace();
+  trace.received = limits.startMicros;
   Search::RootMoves rootMoves;
 
   for (const auto& m : MoveList<LEGAL>(pos))
@@ -199,12 +563,54 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
           || std::count(limits.searchmoves.begin(), limits.searchmoves.end(), m))
           rootMoves.emplace_back(m);
 
-  // After ownership transfer 'states' becomes empty, so if we stop the search
-  // and call 'go' again without setting a new position states.get() == NULL.
+  trace.rootMoves = now_micros();
+
+  // Look up the result of an earlier search of this position. If it is deep
+  // enough for a 'go depth', MainThread::search() answers from it right away.
+  // With a handicap the moves are picked at random and cannot be reused.
+  bool handicap = int(Options["Skill Level"]) < 20 || Options["UCI_LimitStrength"];
+  results.resize(size_t(Options["Result Cache"]));
+  resultKey = handicap || !Options["Result Cache"] ? 0 : result_key(pos, limits);
+  const ResultCache::Result* cached = resultKey ? results.probe(resultKey) : nullptr;
+
+  cachedResult =   cached && limits.depth && cached->depth >= limits.depth
+                && !limits.infinite && !ponderMode;
+
+  // Otherwise, if we searched this position before or the new root is reached
+  // by playing the first moves of the PV of the last search, continue from
+  // the deeper of the two, see seed().
+  Depth startDepth = 0;
+  int ply = pv_ply(pos);
+
+  if (cachedResult)
+      rootMoves = cached->rootMoves, startDepth = cached->depth;
+
+  else if (cached && (ply < 0 || cached->depth >= lastDepth - ply))
+      startDepth = seed(rootMoves, cached->rootMoves[0], cached->depth, 0);
+
+  else if (ply >= 0)
+      startDepth = seed(rootMoves, lastBest, lastDepth, ply);
+
+  // Only the first line is seeded, so with MultiPV the others would enter the
+  // first iteration without a previous score to center their aspiration
+  // window on. We do not skip iterations then.
+  if (handicap || (int(Options["MultiPV"]) > 1 && !cachedResult))
+      startDepth = 0;
+
+  if (limits.depth && !cachedResult)
+      startDepth = std::min(startDepth, limits.depth - 1);
+
+  // We search on a copy of 'states', so that the caller can go on playing moves
+  // on its list while we search. The copies must point to each other.
   assert(states.get() || setupStates.get());
 
   if (states.get())
-      setupStates = std::move(states); // Ownership transfer, states is now empty
+  {
+      setupStates = StateListPtr(new StateList(*states));
+
+      for (size_t i = 1; i < setupStates->size(); ++i)
+          (*setupStates)[i].previous = &(*setupStates)[i - 1];
+  }
 
   // We use Position::set() to set root position across threads. But there are
   // some StateInfo fields (previous, pliesFromNull, capturedPiece) that cannot
@@ -212,20 +618,57 @@ void ThreadPool::start_thinking(Position& pos, StateListPtr& states,
   // we need to backup and later restore setupStates->back(). Note that setupStates
   // is shared by threads but is accessed in read-only mode.
   StateInfo tmp = setupStates->back();
+  std::string fen = pos.fen();
+
+  // Under a latency target of a few ms, waking the helper threads costs more
+  // than they can contribute, so the main thread searches alone and we do
+  // not set up the others. The same holds for a search to depth 1.
+  mainOnly = (limits.latency && limits.latency < 20) || limits.depth == 1;
 
   for (Thread* th : *this)
   {
       th->nodes = th->nmpMinPly = th->bestMoveChanges = 0;
-      th->rootDepth = th->completedDepth = 0;
+
+      if (mainOnly && th != front())
+          continue;
+
+      th->completedDepth = 0;
+      th->rootDepth = startDepth;
       th->rootMoves = rootMoves;
-      th->rootPos.set(pos.fen(), pos.is_chess960(), &setupStates->back(), th);
+      th->rootPos.set(fen, pos.is_chess960(), &setupStates->back(), th);
   }
 
+  if (cachedResult)
+      main()->completedDepth = startDepth;
+
   setupStates->back() = tmp;
+  trace.setup = now_micros();
 
-  main()->start_searching();
+  // A latency target counts from the 'go' command, but the main thread times
+  // the search on its own clock (D), so we take off the time spent so far.
+  if (limits.latency)
+      limits.latency = std::max(TimePoint(1), limits.latency - (now() - limits.startTime));
+}
+
+
+/// ThreadPool::pv_ply() returns how many moves of the PV of the last search,
+/// none to two, lead from its root to the given position, or -1 if none of
+/// these positions match. It only compares keys, as the root of the last
+/// search may have gone, e.g. with the states of a 'batch' pool.
+
+int ThreadPool::pv_ply(const Position& pos) const {
+
+  if (!lastDepth)
+      return -1;
+
+  for (int ply = 0; ply <= lastPlies; ++ply)
+      if (lastKeys[ply] == pos.key())
+          return ply;
+
+  return -1;
 }
 
+
 Thread* ThreadPool::get_best_thread() const {
 
     Thread* bestThread = front();
@@ -23,8 +23,13 @@
 
 #include <atomic>
 #include <condition_variable>
+#include <functional>
+#include <list>
+#include <memory>
 #include <mutex>
+#include <string>
 #include <thread>
+#include <unordered_map>
 #include <vector>
 
 #include "material.h"
@@ -33,6 +38,10 @@
 #include "position.h"
 #include "search.h"
 #include "thread_win32_osx.h"
+#include "timeman.h"
+#include "tt.h"
+
+struct ThreadPool;
 
 
 /// Thread class keeps together all the thread-related stuff. We use
@@ -46,16 +55,26 @@ class Thread {
   std::condition_variable cv;
   size_t idx;
   bool exit = false, searching = true; // Set before starting std::thread
+  std::function<void()> jobFunc;
+
+public:
+  std::atomic_bool threadStarted { false }; // Initialized before std::thread
+  ThreadPool* pool; // The search session this thread belongs to, see ThreadPool::borrow()
+
+private:
   NativeThread stdThread;
 
 public:
-  explicit Thread(size_t);
+  Thread(size_t, ThreadPool*);
   virtual ~Thread();
   virtual void search();
   void clear();
   void idle_loop();
   void start_searching();
+  void run_custom_job(std::function<void()> f);
   void wait_for_search_finished();
+  void wait_for_start();
+  bool is_searching();
   int best_move_count(Move move) const;
 
   Pawns::Table pawnsTable;
@@ -64,7 +83,6 @@ public:
   uint64_t ttHitAverage;
   int selDepth, nmpMinPly;
   Color nmpColor;
-  std::atomic_bool threadStarted;
   std::atomic<uint64_t> nodes, bestMoveChanges;
 
   Position rootPos;
@@ -74,8 +92,25 @@ public:
   ButterflyHistory mainHistory;
   LowPlyHistory lowPlyHistory;
   CapturePieceToHistory captureHistory;
-  ContinuationHistory continuationHistory[2][2];
   Score contempt;
+
+  // With COMPACT_HISTORY the continuation histories used when in check, the
+  // cold half of them, are shared by all the threads of the pool. This saves
+  // 4 MB per helper thread at the price of racy updates, as with the TT.
+#ifdef COMPACT_HISTORY
+  ContinuationHistory continuationHistory[1][2];
+  ContinuationHistory* checkHistory; // [2], owned by the pool
+#else
+  ContinuationHistory continuationHistory[2][2];
+#endif
+
+  ContinuationHistory& continuation_history(bool inCheck, bool capture) {
+#ifdef COMPACT_HISTORY
+    return inCheck ? checkHistory[capture] : continuationHistory[0][capture];
+#else
+    return continuationHistory[inCheck][capture];
+#endif
+  }
 };
 
 
@@ -97,26 +132,91 @@ struct MainThread : public Thread {
 };
 
 
+/// ResultCache is a small LRU cache of the results of completed searches, so
+/// that going back to a position analysed before does not redo the work. It
+/// is keyed by the root position, its history since the last irreversible
+/// move and the limits and options that shape the result, see result_key().
+/// Searches that were stopped are not stored. The 'Result Cache' option sets its size in
+/// entries, 0 disables it.
+
+struct ResultCache {
+
+  struct Result {
+    Key key;
+    Depth depth;
+    Search::RootMoves rootMoves;
+  };
+
+  const Result* probe(Key key);
+  void store(Key key, Depth depth, const Search::RootMoves& rootMoves);
+  void resize(size_t entries);
+  void clear();
+  std::string stats() const;
+
+private:
+  std::list<Result> lru; // Most recently used first
+  std::unordered_map<Key, std::list<Result>::iterator> index;
+  size_t capacity = 0;
+  uint64_t probes = 0, hits = 0;
+};
+
+
 /// ThreadPool struct handles all the threads-related stuff like init, starting,
 /// parking and, most importantly, launching a thread. All the access to threads
 /// is done through this class.
+///
+/// A ThreadPool is also a search session: it owns the limits and the time
+/// management of its search and points to the transposition table it uses.
+/// The global Threads is the default session, others are created with the
+/// 'session' command and searched concurrently.
 
 struct ThreadPool : public std::vector<Thread*> {
 
   void start_thinking(Position&, StateListPtr&, const Search::LimitsType&, bool = false);
+  void setup(Position&, StateListPtr&, const Search::LimitsType&, bool);
   void clear();
   void set(size_t);
+  void resize_tables();
+  void borrow(Thread*);
+  void give_back();
+  std::string memory() const;
+  std::string latency() const;
 
   MainThread* main()        const { return static_cast<MainThread*>(front()); }
   uint64_t nodes_searched() const { return accumulate(&Thread::nodes); }
   Thread* get_best_thread() const;
   void start_searching();
   void wait_for_search_finished() const;
+  int pv_ply(const Position&) const;
+  bool lender_stopped() const { return lender && lender->stop; }
 
   std::atomic_bool stop, increaseDepth;
+  Search::LimitsType limits;
+  TimeManagement time { this };
+  TranspositionTable* tt = &TT;
+  std::string label; // Prefix of our output lines, empty for the default session
+  bool quiet = false; // No info and bestmove output, the caller reports results
+  Search::RootMove lastBest { MOVE_NONE }; // Result of the last search, see
+  Depth lastDepth = 0;                     // ThreadPool::setup()
+  Key lastKeys[3];                         // Of its root and first PV moves
+  int lastPlies;                           // PV moves in lastKeys
+  ResultCache results;
+  Key resultKey;     // Of the current search, 0 if it is not to be cached
+  bool cachedResult; // The current search is answered from the cache
+  bool mainOnly;     // The helper threads sit out the current search
+
+  // Timestamps in microseconds of the steps from receiving 'go' to the first
+  // info line, and how long waking the helpers took, see ThreadPool::latency()
+  struct GoTrace {
+    TimePoint received, rootMoves, setup, mainStart, newSearch, firstInfo, helpers;
+  } trace;
 
 private:
   StateListPtr setupStates;
+  ThreadPool* lender = nullptr; // Of the thread we borrowed, if any
+#ifdef COMPACT_HISTORY
+  std::unique_ptr<ContinuationHistory[]> checkHistory; // See Thread::checkHistory
+#endif
 
   uint64_t accumulate(std::atomic<uint64_t> Thread::* member) const {
 
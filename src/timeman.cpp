@@ -23,10 +23,18 @@
 #include <cmath>
 
 #include "search.h"
+#include "thread.h"
 #include "timeman.h"
 #include "uci.h"
 
-TimeManagement Time; // Our global time management object
+
+/// TimeManagement::elapsed() returns the time since the search started, or the
+/// nodes searched when in 'nodes as time' mode.
+
+TimePoint TimeManagement::elapsed() const {
+
+  return pool->limits.npmsec ? TimePoint(pool->nodes_searched()) : now() - startTime;
+}
 
 
 /// TimeManagement::init() is called at the beginning of the search and calculates
@@ -18,9 +18,22 @@
   along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+#include <cmath>
+#include <cstddef>   // For offsetof
 #include <cstring>   // For std::memset
+#include <fstream>
+#include <iomanip>
 #include <iostream>
+#include <sstream>
 #include <thread>
+#include <vector>
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 #include "bitboard.h"
 #include "misc.h"
@@ -30,42 +43,142 @@
 
 TranspositionTable TT; // Our global transposition table
 
+template<typename KeyType, int ClusterBytes>
+bool TranspositionTableT<KeyType, ClusterBytes>::is_global() const {
+  return (const void*)this == (const void*)&TT;
+}
+
+namespace {
+
+/// HashFileHeader is written in front of the raw clusters by
+/// TranspositionTable::save(). The file is a plain memory dump, so it can only
+/// be loaded on a platform with the same endianness and the same Cluster layout.
+
+struct HashFileHeader {
+  char magic[4];
+  uint32_t clusterSize;
+  uint64_t clusterCount;
+  uint8_t generation8;
+  uint8_t keyBits;
+  uint8_t lockless;
+  uint8_t padding[5];
+};
+
+constexpr char HashFileMagic[4] = { 'S', 'F', 'T', 'T' };
+
+} // namespace
+
 /// TTEntry::save() populates the TTEntry with a new node's data, possibly
-/// overwriting an old position. Update is not atomic and can be racy.
+/// overwriting an old position. The generation and the counters are the ones
+/// of the table the entry belongs to. Update is not atomic and can be racy, see
+/// TTEntryT::fold() for how torn entries can be detected.
+
+template<typename KeyType>
+void TTEntryT<KeyType>::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev, uint8_t generation8, TTStats& stats) {
 
-void TTEntry::save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev) {
+  const KeyType oldKey = stored_key();
 
   // Preserve any existing move for the same position
-  if (m || (uint16_t)k != key16)
+  if (m || (KeyType)k != oldKey)
       move16 = (uint16_t)m;
 
+  if (!oldKey)
+      stats.inc(TTStats::EmptyFills);
+
+  else if ((KeyType)k != oldKey)
+      stats.inc((genBound8 & 0xF8) != generation8 ? TTStats::AgeReplacements
+                                                   : TTStats::DepthReplacements);
+
   // Overwrite less valuable entries
-  if ((uint16_t)k != key16
+  if ((KeyType)k != oldKey
       || d - DEPTH_OFFSET > depth8 - 4
       || b == BOUND_EXACT)
   {
       assert(d >= DEPTH_OFFSET);
 
-      key16     = (uint16_t)k;
       value16   = (int16_t)v;
       eval16    = (int16_t)ev;
-      genBound8 = (uint8_t)(TT.generation8 | uint8_t(pv) << 2 | b);
+      genBound8 = (uint8_t)(generation8 | uint8_t(pv) << 2 | b);
       depth8    = (uint8_t)(d - DEPTH_OFFSET);
   }
+
+  key = (KeyType)k ^ fold(); // Last, after all the folded fields are written
 }
 
 
 /// TranspositionTable::resize() sets the size of the transposition table,
 /// measured in megabytes. Transposition table consists of a power of 2 number
 /// of clusters and each cluster consists of ClusterSize number of TTEntry.
+/// The entries of the old table are rehashed into the new one, so changing
+/// the size does not throw away the results of previous searches. If the
+/// "Shared Hash" option is set to a name other than "<empty>", the table is
+/// mapped from a named shared memory object, and is used by all the engine
+/// processes with the same name, size and entry layout.
 
-void TranspositionTable::resize(size_t mbSize) {
+template<typename KeyType, int ClusterBytes>
+void TranspositionTableT<KeyType, ClusterBytes>::resize(size_t mbSize) {
 
-  Threads.main()->wait_for_search_finished();
+  if (is_global())
+  {
+      UCI::stop_sessions();
+      Threads.main()->wait_for_search_finished();
+  }
+
+  const size_t newClusterCount = mbSize * 1024 * 1024 / sizeof(Cluster);
+  std::string newSharedName;
+
+#ifdef USE_SHARED_TTMEM
+  // The size and the layout of the entries are part of the name, so that
+  // processes with a different Hash setting or built with different ttkey,
+  // ttcluster or ttlockless options never map the same object.
+  if (is_global() && std::string(Options["Shared Hash"]) != "<empty>")
+      newSharedName =  "/" + std::string(Options["Shared Hash"])
+                     + "-" + std::to_string(mbSize) + "mb"
+                     + "-" + std::to_string(sizeof(Entry)) + "x" + std::to_string(ClusterBytes)
+                     + (Lockless ? "-lockless" : "");
+#endif
+
+  if (newClusterCount == clusterCount && newSharedName == sharedName)
+      return;
+
+  void* oldMem = mem;
+  const Cluster* oldTable = table;
+  const size_t oldClusterCount = clusterCount;
+  const std::string oldSharedName = sharedName;
+  const bool oldOwner = sharedOwner;
+  bool created = true;
+
+  mem = nullptr;
+  sharedOwner = false;
+
+  if (!newSharedName.empty())
+  {
+      mem = shared_ttmem_alloc(newSharedName, CacheLineSize + newClusterCount * sizeof(Cluster), created);
 
-  clusterCount = mbSize * 1024 * 1024 / sizeof(Cluster);
+      if (mem)
+          ((SharedHeader*)mem)->users++;
+      else
+          sync_cout << "info string Failed to map shared hash " << newSharedName
+                    << ", using private memory." << sync_endl;
+  }
+
+  if (mem)
+      sharedName = newSharedName;
+  else
+  {
+      sharedName.clear();
+      created = true;
+      mem = malloc(newClusterCount * sizeof(Cluster) + CacheLineSize - 1);
+
+      // Not enough memory to hold both tables, retry without keeping the old one
+      if (!mem && oldMem)
+      {
+          release(oldMem, oldClusterCount, oldSharedName, oldOwner);
+          oldMem = nullptr;
+          mem = malloc(newClusterCount * sizeof(Cluster) + CacheLineSize - 1);
+      }
+  }
 
-  mem = realloc(mem, clusterCount * sizeof(Cluster) + CacheLineSize - 1);
   if (!mem)
   {
       std::cerr << "Failed to allocate " << mbSize
@@ -73,18 +186,194 @@ void TranspositionTable::resize(size_t mbSize) {
       exit(EXIT_FAILURE);
   }
 
-  table = (Cluster*)((uintptr_t(mem) + CacheLineSize - 1) & ~(CacheLineSize - 1));
+  clusterCount = newClusterCount;
 
-  clear();
+  if (is_shared())
+      table = (Cluster*)((char*)mem + CacheLineSize); // After the SharedHeader
+  else
+      table = (Cluster*)((uintptr_t(mem) + CacheLineSize - 1) & ~(CacheLineSize - 1));
+
+  // A table mapped from another process is in use and must be kept as is,
+  // and we take over its generation
+  if (created)
+  {
+      clear();
+
+      if (oldMem)
+          rehash(oldTable, oldClusterCount);
+  }
+
+  if (is_shared())
+  {
+      if (created)
+      {
+          ((SharedHeader*)mem)->generation8 = generation();
+          ((SharedHeader*)mem)->owned = sharedOwner = true;
+      }
+      else
+          generation8 = ((SharedHeader*)mem)->generation8.load();
+  }
+
+  if (oldMem)
+      release(oldMem, oldClusterCount, oldSharedName, oldOwner);
+}
+
+
+/// TranspositionTable::new_search() advances the generation, by 8 as the lower
+/// 3 bits of TTEntry::genBound8 are used by PV flag and Bound. The processes
+/// using a shared table follow a common generation, so that the entries of
+/// one of them do not look old to the others. It is advanced only by the
+/// process owning the table, the one that created it or, once that one has
+/// released it, the first to start a search afterwards, so that entries do
+/// not age faster with more processes searching.
+
+template<typename KeyType, int ClusterBytes>
+void TranspositionTableT<KeyType, ClusterBytes>::new_search() {
+
+  if (is_shared())
+  {
+      SharedHeader* header = (SharedHeader*)mem;
+      bool owned = false;
+
+      if (!sharedOwner)
+          sharedOwner = header->owned.compare_exchange_strong(owned, true);
+
+      if (sharedOwner)
+          header->generation8.fetch_add(8);
+
+      generation8 = header->generation8.load();
+  }
+  else
+      generation8.store(uint8_t(generation() + 8), std::memory_order_relaxed);
+}
+
+
+/// TranspositionTable::release() frees the memory of a table of the given
+/// number of clusters. A shared table is unmapped, and the last process to
+/// release it also removes the shared memory object, so that resizing does not
+/// leave the old table behind. An object left by a process that did not exit
+/// normally has to be removed by hand, e.g. from /dev/shm on Linux.
+
+template<typename KeyType, int ClusterBytes>
+void TranspositionTableT<KeyType, ClusterBytes>::release(void* m, size_t count, const std::string& name, bool owner) {
+
+  if (name.empty())
+  {
+      free(m);
+      return;
+  }
+
+  // Let another process take over advancing the generation
+  if (m && owner)
+      ((SharedHeader*)m)->owned = false;
+
+  const bool last = m && ((SharedHeader*)m)->users.fetch_sub(1) == 1;
+
+  shared_ttmem_free(m, CacheLineSize + count * sizeof(Cluster));
+
+  if (last)
+      shared_ttmem_unlink(name);
+}
+
+
+/// TranspositionTable::rehash() inserts all the entries of a table of the given
+/// number of clusters into the current table. Entries only store 16 bits of the
+/// key, so the exact new cluster of an entry cannot be computed. Instead we use
+/// the fact that mul_hi64() is monotonic in the key: old cluster i covers the
+/// keys that now map to clusters [first, last], and its entries are inserted in
+/// all of them. When growing each new cluster so becomes a copy of its parent,
+/// and a probe finds the same entries as it would have before resizing. When
+/// shrinking, the most valuable entries of the merged clusters are kept.
+
+template<typename KeyType, int ClusterBytes>
+void TranspositionTableT<KeyType, ClusterBytes>::rehash(const Cluster* from, size_t count) {
+
+  for (size_t i = 0; i < count; ++i)
+  {
+      // In 64 bits, since size_t products overflow on 32-bit targets. Both
+      // counts are below 2^32, so their product fits.
+      const size_t first = size_t(uint64_t(i) * clusterCount / count);
+      const size_t last  = size_t((uint64_t(i + 1) * clusterCount - 1) / count);
+
+      for (const Entry& e : from[i].entry)
+          if (e.stored_key())
+              for (size_t j = first; j <= last; ++j)
+                  insert(table[j], e);
+  }
+}
+
+
+/// TranspositionTable::insert() stores a copy of the entry in the cluster,
+/// using the same replacement strategy as probe(). If the cluster already
+/// holds an entry for the same key only the more valuable one is kept.
+
+template<typename KeyType, int ClusterBytes>
+void TranspositionTableT<KeyType, ClusterBytes>::insert(Cluster& cluster, const Entry& e) {
+
+  Entry* replace = &cluster.entry[0];
+
+  for (Entry& tte : cluster.entry)
+  {
+      if (!tte.stored_key() || tte.stored_key() == e.stored_key())
+      {
+          if (!tte.stored_key() || replace_value(e) > replace_value(tte))
+              tte = e;
+          return;
+      }
+
+      if (replace_value(tte) < replace_value(*replace))
+          replace = &tte;
+  }
+
+  if (replace_value(e) > replace_value(*replace))
+      *replace = e;
 }
 
 
 /// TranspositionTable::clear() initializes the entire transposition table to zero,
-//  in a multi-threaded way.
+/// in a multi-threaded way. Unlike upstream we do not spawn new std::threads,
+/// which would again need to yield to the browser (see (A) in thread.cpp), but
+/// hand out the work to the threads of the pool parked in idle_loop(). The
+/// private table of a search session is cleared by the calling thread, because
+/// the pool may be searching meanwhile.
+
+template<typename KeyType, int ClusterBytes>
+void TranspositionTableT<KeyType, ClusterBytes>::clear() {
+
+  if (is_global())
+      UCI::stop_sessions();
 
-void TranspositionTable::clear() {
+  stats.reset();
+
+  const size_t threadCount = is_global() ? Threads.size() : 1;
+  std::vector<Thread*> workers;
+
+  for (size_t idx = 0; idx < threadCount; ++idx)
+  {
+      auto job = [this, idx, threadCount]() {
 
-  std::memset(mem, 0, clusterCount * sizeof(Cluster) + CacheLineSize - 1);
+          // Each thread will zero its part of the hash table
+          const size_t stride = clusterCount / threadCount,
+                       start  = stride * idx,
+                       len    = idx != threadCount - 1 ?
+                                stride : clusterCount - start;
+
+          std::memset(&table[start], 0, len * sizeof(Cluster));
+      };
+
+      // A thread that has not yet reached idle_loop() cannot be waited for
+      // without deadlocking, so zero its part of the table from here.
+      if (is_global() && Threads[idx]->threadStarted)
+      {
+          Threads[idx]->run_custom_job(job);
+          workers.push_back(Threads[idx]);
+      }
+      else
+          job();
+  }
+
+  for (Thread* th : workers)
+      th->wait_for_search_finished();
 }
 
 
@@ -94,29 +383,56 @@ void TranspositionTable::clear() {
 /// to be replaced later. The replace value of an entry is calculated as its depth
 /// minus 8 times its relative age. TTEntry t1 is considered more valuable than
 /// TTEntry t2 if its replace value is greater than that of t2.
+///
+/// The search reads the entry through a copy, whose key is checked again, so
+/// that data changed by other threads since the key check, or with TT_LOCKLESS
+/// torn by them, is never used. The pointer is only for saving.
+
+template<typename KeyType, int ClusterBytes>
+TTEntryT<KeyType>* TranspositionTableT<KeyType, ClusterBytes>::probe(const Key key, bool& found, Entry& data) const {
 
-TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
+  Entry* const tte = probe(key, found);
 
-  TTEntry* const tte = first_entry(key);
-  const uint16_t key16 = (uint16_t)key;  // Use the low 16 bits as key inside the cluster
+  data = *tte;
+  found = found && data.stored_key() == (KeyType)key;
+
+  return tte;
+}
+
+template<typename KeyType, int ClusterBytes>
+TTEntryT<KeyType>* TranspositionTableT<KeyType, ClusterBytes>::probe(const Key key, bool& found) const {
+
+  Entry* const tte = first_entry(key);
+  const KeyType k = (KeyType)key;  // Use the low bits as key inside the cluster
+  const uint8_t gen = generation();
 
   for (int i = 0; i < ClusterSize; ++i)
-      if (!tte[i].key16 || tte[i].key16 == key16)
+  {
+      const KeyType storedKey = tte[i].stored_key();
+
+      if (!storedKey || storedKey == k)
       {
-          tte[i].genBound8 = uint8_t(generation8 | (tte[i].genBound8 & 0x7)); // Refresh
+          tte[i].genBound8 = uint8_t(gen | (tte[i].genBound8 & 0x7)); // Refresh
 
-          return found = (bool)tte[i].key16, &tte[i];
+          stats.inc(TTStats::KeyCompares, i + bool(storedKey));
+          stats.inc(storedKey ? TTStats::Hits : TTStats::Misses);
+
+          return found = (bool)storedKey, &tte[i];
       }
+  }
+
+  stats.inc(TTStats::KeyCompares, ClusterSize);
+  stats.inc(TTStats::Misses);
 
   // Find an entry to be replaced according to the replacement strategy
-  TTEntry* replace = tte;
+  Entry* replace = tte;
   for (int i = 1; i < ClusterSize; ++i)
       // Due to our packed storage format for generation and its cyclic
       // nature we add 263 (256 is the modulus plus 7 to keep the unrelated
       // lowest three bits from affecting the result) to calculate the entry
       // age correctly even after generation8 overflows into the next cycle.
-      if (  replace->depth8 - ((263 + generation8 - replace->genBound8) & 0xF8)
-          >   tte[i].depth8 - ((263 + generation8 -   tte[i].genBound8) & 0xF8))
+      if (  replace->depth8 - ((263 + gen - replace->genBound8) & 0xF8)
+          >   tte[i].depth8 - ((263 + gen -   tte[i].genBound8) & 0xF8))
           replace = &tte[i];
 
   return found = false, replace;
@@ -125,13 +441,351 @@ TTEntry* TranspositionTable::probe(const Key key, bool& found) const {
 
 /// TranspositionTable::hashfull() returns an approximation of the hashtable
 /// occupation during a search. The hash is x permill full, as per UCI protocol.
+/// With SIMD128 a cluster is compared 16 bytes at a time: the generation bits
+/// of each entry are masked out and compared with the current generation,
+/// while the other bytes are compared with a value they cannot have.
 
-int TranspositionTable::hashfull() const {
+template<typename KeyType, int ClusterBytes>
+int TranspositionTableT<KeyType, ClusterBytes>::hashfull() const {
 
   int cnt = 0;
+
+#ifdef USE_SIMD128
+  typedef uint8_t Bytes __attribute__((vector_size(16)));
+  constexpr int Vectors = ClusterBytes / sizeof(Bytes);
+  constexpr int Batch = 255 / Vectors; // Clusters added up before a lane could overflow
+
+  Bytes mask[Vectors], gen[Vectors], sum = {};
+
+  for (int k = 0; k < Vectors; ++k)
+  {
+      mask[k] = Bytes{};
+      gen[k]  = Bytes{} + 1;
+  }
+
+  for (int j = 0; j < ClusterSize; ++j)
+  {
+      size_t at = j * sizeof(Entry) + offsetof(Entry, genBound8);
+      mask[at / sizeof(Bytes)][at % sizeof(Bytes)] = 0xF8;
+      gen[at / sizeof(Bytes)][at % sizeof(Bytes)] = generation();
+  }
+
+  for (int i = 0; i < 1000; ++i)
+  {
+      for (int k = 0; k < Vectors; ++k)
+      {
+          Bytes b;
+          std::memcpy(&b, reinterpret_cast<const char*>(&table[i]) + k * sizeof(Bytes), sizeof(b));
+          sum -= (Bytes)((b & mask[k]) == gen[k]); // Equal lanes are -1
+      }
+
+      if ((i + 1) % Batch == 0 || i == 999)
+      {
+          for (int l = 0; l < int(sizeof(Bytes)); ++l)
+              cnt += sum[l];
+          sum = Bytes{};
+      }
+  }
+#else
   for (int i = 0; i < 1000; ++i)
       for (int j = 0; j < ClusterSize; ++j)
-          cnt += (table[i].entry[j].genBound8 & 0xF8) == generation8;
+          cnt += (table[i].entry[j].genBound8 & 0xF8) == generation();
+#endif
 
   return cnt / ClusterSize;
 }
+
+
+/// TranspositionTable::trace() returns a report of the table usage for the
+/// 'tt stats' debug command. Unlike hashfull(), which samples 1000 clusters,
+/// it scans the whole table to build a histogram of the depths of the live
+/// entries. The probe and store counters are shown if compiled with TT_STATS.
+
+template<typename KeyType, int ClusterBytes>
+std::string TranspositionTableT<KeyType, ClusterBytes>::trace() const {
+
+  uint64_t depthCount[256] = {}, live = 0, current = 0;
+
+  for (size_t i = 0; i < clusterCount; ++i)
+      for (const Entry& e : table[i].entry)
+          if (e.stored_key())
+          {
+              ++live;
+              ++depthCount[e.depth8];
+              current += (e.genBound8 & 0xF8) == generation();
+          }
+
+  const uint64_t total = clusterCount * ClusterSize;
+
+  std::stringstream ss;
+
+  ss << std::fixed << std::setprecision(2)
+     << "Entries            : " << live << " of " << total
+     << " (" << 100.0 * live / total << "%)"
+     << "\nCurrent generation : " << current
+     << " (" << 100.0 * current / total << "%)\n";
+
+#ifdef TT_STATS
+
+  const uint64_t probes = stats[TTStats::Hits] + stats[TTStats::Misses];
+
+  ss << "Probes             : " << probes
+     << "\nHits               : " << stats[TTStats::Hits]
+     << " (" << (probes ? 100.0 * stats[TTStats::Hits] / probes : 0.0) << "%)"
+     << "\nMisses             : " << stats[TTStats::Misses]
+     << "\nEmpty slot fills   : " << stats[TTStats::EmptyFills]
+     << "\nReplaced by age    : " << stats[TTStats::AgeReplacements]
+     << "\nReplaced by depth  : " << stats[TTStats::DepthReplacements]
+     // Each comparison of the key with an unrelated position matches with
+     // probability 1 / 2^KeyBits.
+     << "\nKey collisions     : " << std::ldexp(double(stats[TTStats::KeyCompares]), -KeyBits)
+     << " (estimated)\n";
+
+#else
+
+  ss << "Probe counters     : not available, compile with 'make ttstats=yes'\n";
+
+#endif
+
+  ss << "\n Depth    Entries\n";
+
+  for (int d = 0; d < 256; ++d)
+      if (depthCount[d])
+          ss << std::setw(6) << d + DEPTH_OFFSET << std::setw(11) << depthCount[d] << "\n";
+
+  return ss.str();
+}
+
+
+/// TranspositionTable::stress() hammers a handful of clusters from all the
+/// threads of the pool for the given time, storing and probing entries whose
+/// content is derived from the verified bits of their key. On a hit the entry
+/// is copied and its key checked again, as probe() does for the search.
+/// Copies failing the check were overwritten or, with TT_LOCKLESS, torn since
+/// the probe. Copies passing the check with wrong data are torn entries that
+/// went undetected. Entries already torn at probe time show up as misses with
+/// TT_LOCKLESS. The table is cleared afterwards.
+
+template<typename KeyType, int ClusterBytes>
+std::string TranspositionTableT<KeyType, ClusterBytes>::stress(TimePoint duration) {
+
+  Threads.main()->wait_for_search_finished();
+
+  struct Counters { uint64_t probes = 0, hits = 0, detected = 0, undetected = 0; };
+
+  std::vector<Counters> counters(Threads.size());
+  const TimePoint end = now() + duration;
+
+  auto job = [&](size_t idx) {
+
+      PRNG rng(1070372 + idx);
+      Counters& cnt = counters[idx];
+
+      while (now() < end)
+          for (int i = 0; i < 4096; ++i)
+          {
+              // 16 verification keys in each of 8 clusters spread over the table
+              const uint64_t r = rng.rand<uint64_t>();
+              const Key key = (r & 7) << 61 | (((r >> 3) & 15) + 1);
+
+              // Data only depends on the verified bits, so collisions are consistent
+              const uint64_t h = uint64_t(KeyType(key)) * 0x9E3779B97F4A7C15ULL;
+              const Value v  = Value(int((h >> 16) & 0x3FFF) - 0x2000);
+              const Value ev = Value(int((h >> 32) & 0x3FFF) - 0x2000);
+              const Depth d  = Depth((h >> 48) & 63);
+              const Move  m  = Move(((h >> 54) & 0x3FF) | 1);
+
+              bool found;
+              Entry* tte = probe(key, found);
+              ++cnt.probes;
+
+              if (found)
+              {
+                  const Entry e = *tte;
+
+                  ++cnt.hits;
+
+                  if (e.stored_key() != KeyType(key))
+                      ++cnt.detected;
+
+                  else if (   e.value() != v || e.eval() != ev
+                           || e.depth() != d || e.move()  != m)
+                      ++cnt.undetected;
+              }
+
+              tte->save(key, v, false, BOUND_EXACT, d, m, ev, generation(), stats);
+          }
+  };
+
+  // The calling thread takes the share of the main thread
+  for (size_t idx = 1; idx < Threads.size(); ++idx)
+      Threads[idx]->run_custom_job([&job, idx]() { job(idx); });
+
+  job(0);
+
+  Threads.wait_for_search_finished();
+
+  Counters total;
+  for (const Counters& cnt : counters)
+      total.probes     += cnt.probes,
+      total.hits       += cnt.hits,
+      total.detected   += cnt.detected,
+      total.undetected += cnt.undetected;
+
+  clear();
+
+  std::stringstream ss;
+
+  ss << "Threads            : " << Threads.size()
+     << "\nLockless entries   : " << (Lockless ? "yes" : "no")
+     << "\nProbes             : " << total.probes
+     << "\nHits               : " << total.hits
+     << "\nRejected by key    : " << total.detected
+     << "\nInconsistent data  : " << total.undetected
+     << " (" << std::fixed << std::setprecision(2)
+     << (total.hits ? 1000000.0 * total.undetected / total.hits : 0.0) << " per million hits)\n";
+
+  return ss.str();
+}
+
+
+/// TranspositionTable::save() writes the generation and all the clusters of the
+/// table to the given file, so that a later process can warm-start from it with
+/// load(). In the wasm build the file lives in the Emscripten in-memory
+/// filesystem and can be transferred from JavaScript through Module.FS.
+
+template<typename KeyType, int ClusterBytes>
+bool TranspositionTableT<KeyType, ClusterBytes>::save(const std::string& fname) const {
+
+  Threads.main()->wait_for_search_finished();
+
+  HashFileHeader header = {};
+  std::memcpy(header.magic, HashFileMagic, sizeof(header.magic));
+  header.clusterSize = sizeof(Cluster);
+  header.keyBits = KeyBits;
+  header.lockless = Lockless;
+  header.clusterCount = clusterCount;
+  header.generation8 = generation();
+
+  std::ofstream file(fname, std::ios::binary);
+  file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+  file.write(reinterpret_cast<const char*>(table), clusterCount * sizeof(Cluster));
+
+  return bool(file);
+}
+
+
+/// TranspositionTable::load() reads back a file written by save(). If the
+/// saved table has a different size than the current one, its entries are
+/// rehashed as done by resize(). On native POSIX builds the file is mapped
+/// into memory instead of being read through a stream.
+
+template<typename KeyType, int ClusterBytes>
+bool TranspositionTableT<KeyType, ClusterBytes>::load(const std::string& fname) {
+
+  if (is_global())
+      UCI::stop_sessions();
+
+  Threads.main()->wait_for_search_finished();
+
+  HashFileHeader header;
+
+#if !defined(_WIN32) && !defined(__EMSCRIPTEN__)
+
+  int fd = ::open(fname.c_str(), O_RDONLY);
+  if (fd == -1)
+      return false;
+
+  struct stat statbuf;
+
+  if (fstat(fd, &statbuf) == -1 || size_t(statbuf.st_size) < sizeof(header))
+  {
+      ::close(fd);
+      return false;
+  }
+
+  void* data = mmap(nullptr, statbuf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  ::close(fd);
+
+  if (data == MAP_FAILED)
+      return false;
+
+  std::memcpy(&header, data, sizeof(header));
+
+  bool ok =   !std::memcmp(header.magic, HashFileMagic, sizeof(header.magic))
+           && header.clusterSize == sizeof(Cluster)
+           && header.keyBits == KeyBits
+           && header.lockless == Lockless
+           && header.clusterCount <= uint64_t(statbuf.st_size) / sizeof(Cluster) // No overflow below
+           && uint64_t(statbuf.st_size) - sizeof(header) == header.clusterCount * sizeof(Cluster);
+
+  if (ok)
+  {
+      const Cluster* clusters = (const Cluster*)((const char*)data + sizeof(header));
+
+      if (header.clusterCount == clusterCount)
+          std::memcpy(table, clusters, clusterCount * sizeof(Cluster));
+      else
+      {
+          clear();
+          rehash(clusters, header.clusterCount);
+      }
+
+      generation8 = header.generation8;
+
+      if (is_shared())
+          ((SharedHeader*)mem)->generation8 = generation();
+  }
+
+  munmap(data, statbuf.st_size);
+
+  return ok;
+
+#else
+
+  std::ifstream file(fname, std::ios::binary | std::ios::ate);
+  const uint64_t fileSize = uint64_t(file.tellg());
+  file.seekg(0);
+
+  // Check the cluster count against the file size before allocating for it
+  if (   !file.read(reinterpret_cast<char*>(&header), sizeof(header))
+      ||  std::memcmp(header.magic, HashFileMagic, sizeof(header.magic))
+      ||  header.clusterSize != sizeof(Cluster)
+      ||  header.keyBits != KeyBits
+      ||  header.lockless != Lockless
+      ||  header.clusterCount > fileSize / sizeof(Cluster)
+      ||  fileSize - sizeof(header) != header.clusterCount * sizeof(Cluster))
+      return false;
+
+  if (header.clusterCount == clusterCount)
+  {
+      if (!file.read(reinterpret_cast<char*>(table), clusterCount * sizeof(Cluster)))
+      {
+          clear(); // Do not keep a partially overwritten table
+          return false;
+      }
+  }
+  else
+  {
+      std::vector<Cluster> clusters(header.clusterCount);
+
+      if (!file.read(reinterpret_cast<char*>(clusters.data()), clusters.size() * sizeof(Cluster)))
+          return false;
+
+      clear();
+      rehash(clusters.data(), clusters.size());
+  }
+
+  generation8 = header.generation8;
+
+  if (is_shared())
+      ((SharedHeader*)mem)->generation8 = generation();
+
+  return true;
+
+#endif
+}
+
+// Explicit instantiation of the layout selected at compile time
+template struct TTEntryT<TTKey>;
+template class TranspositionTableT<TTKey, TT_CLUSTER_BYTES>;
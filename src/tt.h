@@ -21,12 +21,41 @@
 #ifndef TT_H_INCLUDED
 #define TT_H_INCLUDED
 
+#include <atomic>
+#include <string>
+
 #include "misc.h"
 #include "types.h"
 
-/// TTEntry struct is the 10 bytes transposition table entry, defined as below:
+/// TTStats holds usage counters of a transposition table, updated by probe()
+/// and TTEntry::save(). The counters only exist when compiled with TT_STATS
+/// ('make ttstats=yes'), otherwise all the member functions are empty.
+
+struct TTStats {
+
+  enum Counter {
+    Hits, Misses, EmptyFills, AgeReplacements, DepthReplacements, KeyCompares,
+    COUNTER_NB
+  };
+
+#ifdef TT_STATS
+  void inc(Counter c, uint64_t n = 1) { counters[c].fetch_add(n, std::memory_order_relaxed); }
+  uint64_t operator[](Counter c) const { return counters[c].load(std::memory_order_relaxed); }
+  void reset() { for (auto& c : counters) c = 0; }
+
+private:
+  std::atomic<uint64_t> counters[COUNTER_NB];
+#else
+  void inc(Counter, uint64_t = 1) {}
+  uint64_t operator[](Counter) const { return 0; }
+  void reset() {}
+#endif
+};
+
+
+/// TTEntryT struct is the transposition table entry, defined as below:
 ///
-/// key        16 bit
+/// key        16 bit (32 bit with 'make ttkey=32')
 /// move       16 bit
 /// value      16 bit
 /// eval value 16 bit
@@ -34,8 +63,11 @@
 /// pv node     1 bit
 /// bound type  2 bit
 /// depth       8 bit
+///
+/// for a total of 10 bytes with the default 16 bit key, or 12 bytes otherwise.
 
-struct TTEntry {
+template<typename KeyType>
+struct TTEntryT {
 
   Move  move()  const { return (Move )move16; }
   Value value() const { return (Value)value16; }
@@ -43,12 +75,35 @@ struct TTEntry {
   Depth depth() const { return (Depth)depth8 + DEPTH_OFFSET; }
   bool is_pv()  const { return (bool)(genBound8 & 0x4); }
   Bound bound() const { return (Bound)(genBound8 & 0x3); }
-  void save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev);
+  void save(Key k, Value v, bool pv, Bound b, Depth d, Move m, Value ev, uint8_t generation8, TTStats& stats);
 
 private:
-  friend class TranspositionTable;
+  template<typename, int> friend class TranspositionTableT;
+
+  // With TT_LOCKLESS ('make ttlockless=yes') the key is stored xor'ed with a
+  // fold of the other fields, so that an entry torn by concurrent writes of
+  // two threads fails the key check of the copy made by probe(). The
+  // generation is left out because probe() refreshes it without rewriting
+  // the key.
+  KeyType fold() const {
+#ifdef TT_LOCKLESS
+    uint64_t data =  uint64_t(move16)
+                   | uint64_t(uint16_t(value16)) << 16
+                   | uint64_t(uint16_t(eval16))  << 32
+                   | uint64_t(genBound8 & 0x7)   << 48
+                   | uint64_t(depth8)            << 56;
+    data ^= data >> 32;
+    if (sizeof(KeyType) < 4)
+        data ^= data >> 16;
+    return KeyType(data);
+#else
+    return 0;
+#endif
+  }
 
-  uint16_t key16;
+  KeyType stored_key() const { return key ^ fold(); }
+
+  KeyType  key;
   uint16_t move16;
   int16_t  value16;
   int16_t  eval16;
@@ -62,40 +117,110 @@ private:
 /// contains information on exactly one position. The size of a Cluster should
 /// divide the size of a cache line for best performance, as the cacheline is
 /// prefetched when possible.
+///
+/// The layout is selected at compile time by the type of the key stored in
+/// each entry and by the size of a cluster in bytes, which is filled with as
+/// many entries as fit. The default, 32 byte clusters of three entries with
+/// 16 bit keys, can be changed with 'make ttkey=32' and 'make ttcluster=64'.
+
+template<typename KeyType, int ClusterBytes>
+class TranspositionTableT {
 
-class TranspositionTable {
+  typedef TTEntryT<KeyType> Entry;
 
   static constexpr int CacheLineSize = 64;
-  static constexpr int ClusterSize = 3;
 
+public:
+  static constexpr int ClusterSize = ClusterBytes / sizeof(Entry);
+  static constexpr int KeyBits = 8 * sizeof(KeyType);
+#ifdef TT_LOCKLESS
+  static constexpr bool Lockless = true;
+#else
+  static constexpr bool Lockless = false;
+#endif
+
+private:
   struct Cluster {
-    TTEntry entry[ClusterSize];
-    char padding[2]; // Pad to 32 bytes
+    Entry entry[ClusterSize];
+    char padding[ClusterBytes - ClusterSize * sizeof(Entry)]; // Pad to ClusterBytes
+  };
+
+  static_assert(sizeof(Cluster) == ClusterBytes, "Unexpected Cluster size");
+  static_assert(CacheLineSize % ClusterBytes == 0, "Cluster must divide a cache line");
+
+  // A shared table starts with a cache line of its own that counts the
+  // processes using it and holds the generation they share, see resize().
+  // Only the process owning the table advances the generation.
+  struct SharedHeader {
+    std::atomic<uint32_t> users;
+    std::atomic<uint8_t> generation8;
+    std::atomic<bool> owned;
   };
 
-  static_assert(sizeof(Cluster) == 32, "Unexpected Cluster size");
+  static_assert(sizeof(SharedHeader) <= CacheLineSize, "SharedHeader must fit in a cache line");
 
 public:
- ~TranspositionTable() { free(mem); }
-  void new_search() { generation8 += 8; } // Lower 3 bits are used by PV flag and Bound
-  TTEntry* probe(const Key key, bool& found) const;
+ ~TranspositionTableT() { release(mem, clusterCount, sharedName, sharedOwner); }
+  void new_search();
+  uint8_t generation() const { return generation8.load(std::memory_order_relaxed); }
+  TTStats& statistics() const { return stats; }
+  Entry* probe(const Key key, bool& found, Entry& data) const;
   int hashfull() const;
   void resize(size_t mbSize);
   void clear();
-
-  TTEntry* first_entry(const Key key) const {
+  bool save(const std::string& fname) const;
+  bool load(const std::string& fname);
+  std::string trace() const;
+  std::string stress(TimePoint duration);
+  bool is_shared() const { return !sharedName.empty(); }
+  bool is_global() const; // True for TT, false for private session tables
+  size_t bytes() const { return clusterCount * sizeof(Cluster); }
+
+  Entry* first_entry(const Key key) const {
     return &table[mul_hi64(key, clusterCount)].entry[0];
   }
 
 private:
-  friend struct TTEntry;
+  void rehash(const Cluster* from, size_t count);
+  Entry* probe(const Key key, bool& found) const;
+
+  static void release(void* m, size_t count, const std::string& name, bool owner);
+
+  void insert(Cluster& cluster, const Entry& e);
+
+  // Same replace value as used by probe(): depth minus 8 times relative age
+  int replace_value(const Entry& e) const {
+    return e.depth8 - ((263 + generation() - e.genBound8) & 0xF8);
+  }
 
   size_t clusterCount;
   Cluster* table;
   void* mem;
-  uint8_t generation8; // Size must be not bigger than TTEntry::genBound8
+  std::string sharedName;
+  bool sharedOwner; // True if this process advances the shared generation
+  // Advanced by new_search() of the session the table belongs to, and read
+  // by the threads of all the sessions using it
+  std::atomic<uint8_t> generation8; // Size must be not bigger than TTEntry::genBound8
+  mutable TTStats stats;
 };
 
+#ifndef TT_KEY_BITS
+#define TT_KEY_BITS 16
+#endif
+
+#ifndef TT_CLUSTER_BYTES
+#define TT_CLUSTER_BYTES 32
+#endif
+
+#if TT_KEY_BITS == 32
+typedef uint32_t TTKey;
+#else
+typedef uint16_t TTKey;
+#endif
+
+typedef TTEntryT<TTKey> TTEntry;
+typedef TranspositionTableT<TTKey, TT_CLUSTER_BYTES> TranspositionTable;
+
 extern TranspositionTable TT;
 
 #endif // #ifndef TT_H_INCLUDED
@@ -21,10 +21,13 @@
 #include <cassert>
 #include <cmath>
 #include <iostream>
+#include <map>
+#include <memory>
 #include <sstream>
 #include <string>
 #include <emscripten.h>
 
+#include "endgame.h"
 #include "evaluate.h"
 #include "movegen.h"
 #include "position.h"
@@ -37,6 +40,7 @@
 using namespace std;
 
 extern vector<string> setup_bench(const Position&, istream&);
+extern bool read_fens(const Position&, const string&, vector<string>&);
 
 namespace {
 
@@ -47,9 +51,11 @@ namespace {
   // position() is called when engine receives the "position" UCI command.
   // The function sets up the position described in the given FEN string ("fen")
   // or the starting position ("startpos") and then makes the moves given in the
-  // following move list ("moves").
+  // following move list ("moves"). If the FEN is the one of the last command,
+  // the moves both lists start with are kept and only the rest is played.
 
-  void position(Position& pos, istringstream& is, StateListPtr& states) {
+  void position(Position& pos, istringstream& is, StateListPtr& states,
+                ThreadPool& pool = Threads, bool chess960 = Options["UCI_Chess960"]) {
 
     Move m;
     string token, fen;
@@ -67,14 +73,44 @@ namespace {
     else
         return;
 
-    states = StateListPtr(new std::deque<StateInfo>(1)); // Drop old and create a new one
-    pos.set(fen, Options["UCI_Chess960"], &states->back(), Threads.main());
+    vector<string> moves;
+    while (is >> token)
+    {
+        if (token.length() == 5) // As in UCI::to_move()
+            token[4] = char(tolower(token[4]));
+        moves.push_back(token);
+    }
+
+    size_t common = 0;
+
+    if (   states->fen == fen
+        && pos.is_chess960() == chess960
+        && pos.this_thread() == pool.main())
+        while (   common < moves.size()
+               && common < states->moves.size()
+               && UCI::move(states->moves[common], chess960) == moves[common])
+            ++common;
+    else
+    {
+        states = StateListPtr(new StateList(1)); // Drop old and create a new one
+        pos.set(fen, chess960, &states->back(), pool.main());
+        states->fen = fen;
+    }
+
+    // Take back the moves that are not in the new list
+    while (states->moves.size() > common)
+    {
+        pos.undo_move(states->moves.back());
+        states->moves.pop_back();
+        states->pop_back();
+    }
 
-    // Parse move list (if any)
-    while (is >> token && (m = UCI::to_move(pos, token)) != MOVE_NONE)
+    // Parse the rest of the move list (if any)
+    for (size_t i = common; i < moves.size() && (m = UCI::to_move(pos, moves[i])) != MOVE_NONE; ++i)
     {
         states->emplace_back();
         pos.do_move(m, states->back());
+        states->moves.push_back(m);
     }
   }
 
@@ -103,17 +139,73 @@ namespace {
   }
 
 
+  // hash_file() is called when engine receives the "hash" command. It saves the
+  // transposition table to a file ("save") or restores it from one ("load").
+  // Both would have to wait for the search to finish, holding up the commands
+  // behind them, so they are refused while the default session is searching.
+
+  void hash_file(istringstream& is) {
+
+    string token, fname;
+
+    is >> token;
+    getline(is >> ws, fname); // File name can contain spaces
+
+    if (fname.empty() || (token != "save" && token != "load"))
+    {
+        sync_cout << "Usage: hash save|load <file>" << sync_endl;
+        return;
+    }
+
+    if (Threads.main()->is_searching())
+    {
+        sync_cout << "info string Hash " << token << " refused while searching" << sync_endl;
+        return;
+    }
+
+    bool ok = token == "save" ? TT.save(fname) : TT.load(fname);
+
+    sync_cout << "info string Hash " << (token == "save" ? "save to " : "load from ")
+              << fname << (ok ? " succeeded" : " failed") << sync_endl;
+  }
+
+
+  // tt_debug() is called when engine receives the "tt" command. "tt stats"
+  // reports the usage of the transposition table, "tt stress <ms>" stores and
+  // probes a few clusters from all the threads and counts the torn entries.
+
+  void tt_debug(istringstream& is) {
+
+    string token;
+    TimePoint duration = 1000;
+
+    is >> token;
+
+    if (token == "stats")
+        sync_cout << TT.trace() << sync_endl;
+
+    else if (token == "stress")
+    {
+        is >> duration;
+        sync_cout << TT.stress(duration) << sync_endl;
+    }
+    else
+        sync_cout << "Usage: tt stats|stress [ms]" << sync_endl;
+  }
+
+
   // go() is called when engine receives the "go" UCI command. The function sets
   // the thinking time and other parameters from the input string, then starts
   // the search.
 
-  void go(Position& pos, istringstream& is, StateListPtr& states) {
+  void go(Position& pos, istringstream& is, StateListPtr& states, ThreadPool& pool = Threads) {
 
     Search::LimitsType limits;
     string token;
     bool ponderMode = false;
 
     limits.startTime = now(); // As early as possible!
+    limits.startMicros = now_micros();
 
     while (is >> token)
         if (token == "searchmoves") // Needs to be the last command on the line
@@ -128,12 +220,219 @@ namespace {
         else if (token == "depth")     is >> limits.depth;
         else if (token == "nodes")     is >> limits.nodes;
         else if (token == "movetime")  is >> limits.movetime;
+        else if (token == "latency")   is >> limits.latency;
         else if (token == "mate")      is >> limits.mate;
         else if (token == "perft")     is >> limits.perft;
         else if (token == "infinite")  limits.infinite = 1;
         else if (token == "ponder")    ponderMode = true;
 
-    Threads.start_thinking(pos, states, limits, ponderMode);
+    pool.start_thinking(pos, states, limits, ponderMode);
+  }
+
+
+  // Session is a search session created with the 'session' command. It searches
+  // concurrently with the default session (Threads, TT and the position of
+  // uci_command) and has its own threads, root position and optionally its own
+  // transposition table.
+
+  struct Session {
+    ThreadPool pool;
+    Position pos;
+    StateListPtr states = StateListPtr(new StateList(1));
+    std::unique_ptr<TranspositionTable> tt; // Null when sharing TT
+  };
+
+  map<string, unique_ptr<Session>> Sessions;
+  bool RebalancePending = false; // See UCI::rebalance()
+
+
+  // session() is called when engine receives the "session" command. It creates
+  // ("new <name> [threads <n>] [hash <mb>]") or deletes ("close <name>") a
+  // session, or passes "position", "go", "stop", "ponderhit" and "ucinewgame"
+  // to one ("<name> <command>"). Output of a session starts with "session <name>".
+
+  void session(istringstream& is) {
+
+    string token, name;
+    is >> token;
+
+    if (token == "new" || token == "close")
+        is >> name;
+
+    if (token == "new" && !name.empty() && !Sessions.count(name))
+    {
+        size_t threads = 1, hash = 0;
+        while (is >> token)
+            if (token == "threads")   is >> threads;
+            else if (token == "hash") is >> hash;
+
+        Session* s = new Session();
+        Sessions[name].reset(s);
+        s->pool.label = "session " + name + " ";
+        s->pool.set(std::max(threads, size_t(1)));
+
+        if (hash)
+        {
+            s->tt.reset(new TranspositionTable());
+            s->tt->resize(hash);
+            s->pool.tt = s->tt.get();
+        }
+
+        s->pos.set(StartFEN, false, &s->states->back(), s->pool.main());
+        UCI::rebalance();
+        return;
+    }
+
+    if (token == "close" && Sessions.count(name))
+    {
+        Sessions[name]->pool.stop = true;
+        Sessions[name]->pool.set(0);
+        Sessions.erase(name);
+        UCI::rebalance();
+        return;
+    }
+
+    if (!Sessions.count(token))
+    {
+        sync_cout << "Usage: session new|close <name> or session <name> <command>" << sync_endl;
+        return;
+    }
+
+    Session& s = *Sessions[token];
+    is >> token;
+
+    for (Thread* th : s.pool)
+        th->wait_for_start();
+
+    if      (token == "stop")       s.pool.stop = true;
+    else if (token == "ponderhit")  s.pool.main()->ponder = false;
+    else if (token == "position")   position(s.pos, is, s.states, s.pool);
+    else if (token == "go")         go(s.pos, is, s.states, s.pool);
+    else if (token == "ucinewgame")
+    {
+        s.pool.main()->wait_for_search_finished();
+        s.pool.time.availableNodes = 0;
+        if (s.tt)
+            s.tt->clear();
+        s.pool.clear();
+    }
+  }
+
+
+  // batch() is called when engine receives the "batch" command. It searches a
+  // list of positions, read like the ones of bench from a file or given inline
+  // and separated by ';', to a fixed depth or node count:
+  //
+  // batch [depth <d>] [nodes <n>] [default|current|file <name>|fen <fen> [; <fen>...]]
+  //
+  // There is one single threaded search per thread of the default session, each
+  // taking the next position when done, and one result line per position. The
+  // searches run in pools of their own, borrowing the threads of the session.
+
+  void batch(Position& pos, istringstream& is) {
+
+    Search::LimitsType limits;
+    vector<string> fens;
+    vector<pair<string, bool>> list; // Position and whether it is Chess960
+    string token, fenFile = "default";
+    bool chess960 = Options["UCI_Chess960"];
+
+    while (is >> token)
+        if (token == "depth")      is >> limits.depth;
+        else if (token == "nodes") is >> limits.nodes;
+        else if (token == "file")  is >> fenFile;
+        else if (token == "default" || token == "current") fenFile = token;
+        else if (token == "fen")
+            while (getline(is, token, ';'))
+                fens.push_back(token);
+
+    if (fens.empty() && !read_fens(pos, fenFile, fens))
+    {
+        sync_cout << "Unable to open file " << fenFile << sync_endl;
+        return;
+    }
+
+    // Skip anything but a board with 8 ranks, like the opcodes of inline EPD
+    for (const string& fen : fens)
+    {
+        string board;
+        istringstream(fen) >> board;
+
+        if (fen.find("UCI_Chess960") != string::npos)
+            chess960 = fen.find("value true") != string::npos;
+
+        else if (std::count(board.begin(), board.end(), '/') == 7)
+            list.emplace_back(fen, chess960);
+    }
+
+    if (!limits.depth && !limits.nodes)
+        limits.depth = 13;
+
+    vector<unique_ptr<ThreadPool>> pools(std::max(std::min(Threads.size(), list.size()), size_t(1)));
+    std::atomic<size_t> next(0), done(0);
+    std::atomic<uint64_t> nodes(0);
+
+    for (size_t idx = 0; idx < pools.size(); ++idx)
+    {
+        Threads[idx]->wait_for_start();
+        pools[idx].reset(new ThreadPool());
+        pools[idx]->quiet = true;
+        pools[idx]->borrow(Threads[idx]);
+    }
+
+    // The pools do not advance the generation of TT, see MainThread::search(),
+    // so the whole batch counts as one new search. A 'stop' ends it, as the
+    // pools stop with the one they borrowed from.
+    TT.new_search();
+    Threads.stop = false;
+
+    TimePoint elapsed = now();
+
+    for (auto& p : pools)
+    {
+        ThreadPool& pool = *p;
+
+        pool.main()->run_custom_job([&]() {
+
+            for (size_t i; !Threads.stop && (i = next++) < list.size(); )
+            {
+                Position rootPos;
+                StateListPtr states(new StateList(1));
+                istringstream ss("fen " + list[i].first);
+
+                position(rootPos, ss, states, pool, list[i].second);
+                pool.setup(rootPos, states, limits, false);
+                pool.main()->search();
+                nodes += pool.nodes_searched();
+                ++done;
+
+                const Search::RootMove& rm = pool.main()->rootMoves[0];
+                Value v = rm.pv[0] == MOVE_NONE ? (rootPos.checkers() ? -VALUE_MATE : VALUE_DRAW)
+                        : rm.score != -VALUE_INFINITE ? rm.score : rm.previousScore;
+
+                stringstream pv;
+                for (Move m : rm.pv)
+                    pv << " " << UCI::move(m, rootPos.is_chess960());
+
+                sync_cout << "batch " << i + 1
+                          << " depth " << pool.main()->completedDepth
+                          << (v != -VALUE_INFINITE ? " score " + UCI::value(v) : "")
+                          << " nodes " << pool.nodes_searched()
+                          << " bestmove " << UCI::move(rm.pv[0], rootPos.is_chess960())
+                          << " pv" << pv.str() << sync_endl;
+            }
+        });
+    }
+
+    for (auto& p : pools)
+        p->give_back();
+
+    elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
+
+    sync_cout << "batch done positions " << done
+              << " nodes " << nodes
+              << " time " << elapsed
+              << " nps " << 1000 * nodes / elapsed << sync_endl;
   }
 
 
@@ -145,6 +444,7 @@ namespace {
 
     string token;
     uint64_t num, nodes = 0, cnt = 1;
+    TimePoint clearTime = 0;
 
     vector<string> list = setup_bench(pos, args);
     num = count_if(list.begin(), list.end(), [](string s) { return s.find("go ") == 0 || s.find("eval") == 0; });
@@ -170,7 +470,13 @@ namespace {
         }
         else if (token == "setoption")  setoption(is);
         else if (token == "position")   position(pos, is, states);
-        else if (token == "ucinewgame") { Search::clear(); elapsed = now(); } // Search::clear() may take some while
+        else if (token == "ucinewgame")
+        {
+            clearTime = now();
+            Search::clear(); // Search::clear() may take some while
+            elapsed = now();
+            clearTime = elapsed - clearTime;
+        }
     }
 
     elapsed = now() - elapsed + 1; // Ensure positivity to avoid a 'divide by zero'
@@ -178,6 +484,10 @@ namespace {
     dbg_print(); // Just before exiting
 
     cerr << "\n==========================="
+         << "\nTT layout       : " << TranspositionTable::ClusterSize << " x "
+                                   << TranspositionTable::KeyBits << " bit keys in "
+                                   << TT_CLUSTER_BYTES << " bytes"
+         << "\nHash clear (ms) : " << clearTime
          << "\nTotal time (ms) : " << elapsed
          << "\nNodes searched  : " << nodes
          << "\nNodes/second    : " << 1000 * nodes / elapsed << endl;
@@ -220,11 +530,29 @@ EMSCRIPTEN_KEEPALIVE extern "C" int uci_command(const char *c_cmd) {
   static bool initialized = false;
   static Position pos;
   string token;
-  static StateListPtr states(new std::deque<StateInfo>(1));
+  static StateListPtr states(new StateList(1));
 
-  if (!initialized) {
-      pos.set(StartFEN, false, &states->back(), Threads.main());
-      initialized = true;
+      istringstream is(cmd);
+
+      token.clear(); // Avoid a stale if getline() returns empty or blank line
+      is >> skipws >> token;
+
+  // Only a few commands can be answered before the threads are up
+  if (   !Threads.size()
+      && token != "uci"  && token != "isready" && token != "setoption"
+      && token != "quit" && token != "stop"    && token != "startup" && token != "compiler"
+      && token != "attacks")
+      UCI::init_search();
+
+  // Resize the default session as deferred by UCI::rebalance() once its search
+  // is over, at the latest before it starts the next one
+  if (   RebalancePending
+      && token != "stop" && token != "quit" && token != "ponderhit")
+  {
+      if (token == "go")
+          Threads.main()->wait_for_search_finished();
+
+      UCI::rebalance();
   }
 
   for (Thread* th : Threads) {
@@ -232,10 +560,10 @@ EMSCRIPTEN_KEEPALIVE extern "C" int uci_command(const char *c_cmd) {
           return 1;
   }
 
-      istringstream is(cmd);
-
-      token.clear(); // Avoid a stale if getline() returns empty or blank line
-      is >> skipws >> token;
+  if (!initialized && Threads.size()) {
+      pos.set(StartFEN, false, &states->back(), Threads.main());
+      initialized = true;
+  }
 
       if (    token == "quit"
           ||  token == "stop")
@@ -253,19 +581,38 @@ EMSCRIPTEN_KEEPALIVE extern "C" int uci_command(const char *c_cmd) {
                     << "\n"       << Options
                     << "\nuciok"  << sync_endl;
 
+      // A shared hash also holds the results of other processes, so we leave
+      // it to the 'Clear Hash' option
+      else if (token == "ucinewgame")
+      {
+          Search::clear();
+
+          if (TT.is_shared())
+              sync_cout << "info string Shared hash not cleared, use Clear Hash to clear it"
+                        << sync_endl;
+      }
+
       else if (token == "setoption")  setoption(is);
       else if (token == "go")         go(pos, is, states);
       else if (token == "position")   position(pos, is, states);
-      else if (token == "ucinewgame") Search::clear();
       else if (token == "isready")    sync_cout << "readyok" << sync_endl;
 
       // Additional custom non-UCI commands, mainly for debugging.
       // Do not use these commands during a search!
-      else if (token == "flip")     pos.flip();
+      else if (token == "flip")     pos.flip(), states->fen.clear(); // Moves no longer apply
       else if (token == "bench")    bench(pos, is, states);
       else if (token == "d")        sync_cout << pos << sync_endl;
       else if (token == "eval")     sync_cout << Eval::trace(pos) << sync_endl;
       else if (token == "compiler") sync_cout << compiler_info() << sync_endl;
+      else if (token == "hash")     hash_file(is);
+      else if (token == "tt")       tt_debug(is);
+      else if (token == "memory")   sync_cout << Threads.memory() << sync_endl;
+      else if (token == "cache")    sync_cout << Threads.results.stats() << sync_endl;
+      else if (token == "latency")  sync_cout << Threads.latency() << sync_endl;
+      else if (token == "startup")  sync_cout << Startup::report() << sync_endl;
+      else if (token == "attacks")  sync_cout << Bitboards::attacks_speed() << sync_endl;
+      else if (token == "session")  session(is);
+      else if (token == "batch")    batch(pos, is);
       else
           sync_cout << "Unknown command: " << cmd << sync_endl;
 
@@ -273,6 +620,95 @@ EMSCRIPTEN_KEEPALIVE extern "C" int uci_command(const char *c_cmd) {
 }
 
 
+/// uci_stop() stops the search right away. JavaScript calls it from the
+/// browser thread when 'stop' is posted, so that the search does not keep
+/// running while earlier commands are still waiting in CommandBox. The 'stop'
+/// command itself is queued as well, in case one of those is a 'go'.
+
+EMSCRIPTEN_KEEPALIVE extern "C" void uci_stop() {
+
+  Threads.stop = true;
+}
+
+
+/// uci_mailbox() gives JavaScript the address of the command mailbox or, when
+/// 'output' is set, of the output mailbox.
+
+EMSCRIPTEN_KEEPALIVE extern "C" Mailbox* uci_mailbox(int output) {
+
+  return output ? &OutputBox : &CommandBox;
+}
+
+
+/// UCI::mailbox_loop() is the command loop of the wasm build. It runs on a
+/// thread of its own and blocks on CommandBox, so that a command is executed
+/// as soon as JavaScript has written it. Unlike the browser thread it can also
+/// wait for threads that are still starting.
+
+void UCI::mailbox_loop() {
+
+  string cmd;
+
+  while (CommandBox.read_line(cmd))
+      while (uci_command(cmd.c_str())) // Threads are still starting
+          for (Thread* th : Threads)
+              th->wait_for_start();
+}
+
+
+/// UCI::init_search() sets up what is only needed to search: the endgame maps,
+/// the threads, the hash table and the search tables. main() leaves it to the
+/// first command that needs them, so that 'uci' and 'isready' are answered as
+/// soon as the engine is loaded. Options set before are applied here.
+
+void UCI::init_search() {
+
+  Startup::timed("Endgames::init", [] { Endgames::init(); });
+  Startup::timed("Threads.set",    [] { Threads.set(size_t(Options["Threads"])); });
+  Startup::timed("TT.resize",      [] { TT.resize(Options["Hash"]); }); // After threads are up
+  Startup::timed("Search::clear",  [] { Search::clear(); }); // After threads are up
+}
+
+
+/// UCI::rebalance() is our scheduler. It gives the default session whatever is
+/// left of 'Threads' after the other sessions took theirs, but at least one
+/// thread. It is called when the option or the sessions change. Resizing waits
+/// for the search of the default session, so while it searches, e.g. on 'go
+/// infinite', the resize is left to uci_command() and the command loop stays
+/// free to read the 'stop' that ends it.
+
+void UCI::rebalance() {
+
+  size_t used = 0;
+  for (const auto& s : Sessions)
+      used += s.second->pool.size();
+
+  size_t total = size_t(Options["Threads"]);
+
+  RebalancePending = Threads.main()->is_searching();
+
+  if (!RebalancePending)
+      Threads.set(total > used + 1 ? total - used : 1);
+}
+
+
+/// UCI::stop_sessions() stops the search sessions sharing TT and waits for
+/// them, so that the table can be resized, cleared or loaded under them.
+
+void UCI::stop_sessions() {
+
+  for (const auto& s : Sessions)
+      if (!s.second->tt)
+      {
+          for (Thread* th : s.second->pool)
+              th->wait_for_start();
+
+          s.second->pool.stop = true;
+          s.second->pool.main()->wait_for_search_finished();
+      }
+}
+
+
 /// UCI::value() converts a Value to a string suitable for use with the UCI
 /// protocol specification:
 ///
@@ -347,16 +783,50 @@ string UCI::move(Move m, bool chess960) {
 
 
 /// UCI::to_move() converts a string representing a move in coordinate notation
-/// (g1f3, a7a8q) to the corresponding legal Move, if any.
+/// (g1f3, a7a8q) to the corresponding legal Move, if any. The Move is built
+/// from the squares and then validated, instead of generating all legal moves.
 
 Move UCI::to_move(const Position& pos, string& str) {
 
   if (str.length() == 5) // Junior could send promotion piece in uppercase
       str[4] = char(tolower(str[4]));
 
-  for (const auto& m : MoveList<LEGAL>(pos))
-      if (str == UCI::move(m, pos.is_chess960()))
-          return m;
+  if (   str.length() < 4 || str.length() > 5
+      || str[0] < 'a' || str[0] > 'h' || str[1] < '1' || str[1] > '8'
+      || str[2] < 'a' || str[2] > 'h' || str[3] < '1' || str[3] > '8')
+      return MOVE_NONE;
+
+  Square from = make_square(File(str[0] - 'a'), Rank(str[1] - '1'));
+  Square to   = make_square(File(str[2] - 'a'), Rank(str[3] - '1'));
+  Piece pc = pos.piece_on(from);
+  Color us = pos.side_to_move();
+  Move m;
+
+  if (from == to)
+      return MOVE_NONE;
+
+  if (str.length() == 5)
+  {
+      size_t pt = string(" pnbrq").find(str[4]);
+
+      if (pt < KNIGHT || pt > QUEEN)
+          return MOVE_NONE;
+
+      m = make<PROMOTION>(from, to, PieceType(pt));
+  }
+  // Castling is encoded as 'king captures rook'. In Chess960 the GUI sends it
+  // that way, otherwise as a king move by two files.
+  else if (   pc == make_piece(us, KING)
+           && (pos.is_chess960() ? pos.piece_on(to) == make_piece(us, ROOK)
+                                 : distance<File>(from, to) == 2 && rank_of(from) == rank_of(to)))
+      m = make<CASTLING>(from, pos.is_chess960() ? to
+                         : make_square(to > from ? FILE_H : FILE_A, rank_of(from)));
+
+  else if (pc == make_piece(us, PAWN) && to == pos.ep_square())
+      m = make<ENPASSANT>(from, to);
+
+  else
+      m = make_move(from, to);
 
-  return MOVE_NONE;
+  return pos.pseudo_legal(m) && pos.legal(m) ? m : MOVE_NONE;
 }
@@ -69,6 +69,10 @@ private:
 
 void init(OptionsMap&);
 void loop(int argc, char* argv[]);
+void mailbox_loop();
+void init_search();
+void stop_sessions();
+void rebalance();
 std::string value(Value v);
 std::string square(Square s);
 std::string move(Move m, bool chess960);
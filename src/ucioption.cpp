@@ -35,11 +35,14 @@ UCI::OptionsMap Options; // Global object
 
 namespace UCI {
 
-/// 'On change' actions, triggered by an option's value change
-void on_clear_hash(const Option&) { Search::clear(); }
-void on_hash_size(const Option& o) { TT.resize(size_t(o)); }
+/// 'On change' actions, triggered by an option's value change. Before the
+/// threads are up, init_search() applies the options instead.
+void on_clear_hash(const Option&) { if (Threads.size()) Search::clear(true); }
+void on_hash_size(const Option& o) { if (Threads.size()) TT.resize(size_t(o)); }
 void on_logger(const Option& o) { start_logger(o); }
-void on_threads(const Option& o) { Threads.set(size_t(o)); }
+void on_threads(const Option&) { if (Threads.size()) rebalance(); }
+void on_shared_hash(const Option&) { if (Threads.size()) TT.resize(size_t(Options["Hash"])); }
+void on_table_size(const Option&) { if (Threads.size()) Threads.resize_tables(); }
 
 
 /// Our case insensitive less() function as required by UCI protocol
@@ -63,6 +66,14 @@ void init(OptionsMap& o) {
   o["Threads"]               << Option(1, 1, 32, on_threads);
   o["Hash"]                  << Option(16, 1, MaxHashMB, on_hash_size);
   o["Clear Hash"]            << Option(on_clear_hash);
+  o["Pawn Hash"]             << Option(Pawns::Table::DefaultKB, 1, 65536, on_table_size);
+  o["Material Hash"]         << Option(Material::Table::DefaultKB, 1, 16384, on_table_size);
+  o["Result Cache"]          << Option(0, 0, 10000);
+#ifdef USE_SHARED_TTMEM
+  // Native builds only, where commands come from an embedder calling
+  // uci_command(), as main() starts no command loop outside of the browser
+  o["Shared Hash"]           << Option("<empty>", on_shared_hash);
+#endif
   o["Ponder"]                << Option(false);
   o["MultiPV"]               << Option(1, 1, 500);
   o["Skill Level"]           << Option(20, 0, 20);
@@ -0,0 +1,41 @@
+#!/bin/bash
+# verify that batch reports one result per position
+
+error()
+{
+  echo "batch testing failed on line $1"
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+echo "batch testing started"
+
+# results arrive in completion order, so only the summary line is checked
+# after the first result
+cat << EOF > batch.exp
+ set timeout 30
+ spawn ./stockfish
+ lassign \$argv threads
+
+ send "setoption name Threads value \$threads\n"
+ send "batch depth 6 fen 8/P6k/8/8/8/8/8/K7 w - - 0 1 ; 4k3/8/8/8/8/8/8/4K2R w K - 0 1 ; 7k/8/8/8/8/8/8/RK6 w - - 0 1\n"
+ expect -re "batch \[1-3\] depth 6 score (cp|mate) -?\[0-9\]+ nodes \[0-9\]+ bestmove \[a-h1-8qrbn\]+ pv" {} timeout {exit 1}
+ expect -re "batch done positions 3 nodes \[0-9\]+" {} timeout {exit 1}
+
+ send "position startpos\n"
+ send "batch depth 4 current\n"
+ expect -re "batch 1 depth 4 score cp \[0-9\]+ nodes \[0-9\]+ bestmove" {} timeout {exit 1}
+ expect "batch done positions 1" {} timeout {exit 1}
+
+ send "quit\n"
+ expect eof
+EOF
+
+for threads in 1 2
+do
+  expect batch.exp ${threads} > /dev/null
+done
+
+rm batch.exp
+
+echo "batch testing OK"
@@ -0,0 +1,54 @@
+#!/bin/bash
+# verify that the result cache answers repeated searches
+
+error()
+{
+  echo "cache testing failed on line $1"
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+echo "cache testing started"
+
+# a repeated search is answered without searching, a deeper one continues from
+# the stored result, and a new position or move order misses
+cat << EOF > cache.exp
+ set timeout 30
+ spawn ./stockfish
+
+ send "setoption name Result Cache value 4\n"
+ send "position startpos moves e2e4 e7e5 g1f3\n"
+ send "go depth 8\n"
+ expect -re "info depth 8 \[^\n\]* nodes \[1-9\]" {} timeout {exit 1}
+ expect "bestmove" {} timeout {exit 1}
+
+ send "go depth 8\n"
+ expect -re "info depth 8 \[^\n\]* nodes 0 " {} timeout {exit 1}
+ expect "bestmove" {} timeout {exit 1}
+
+ send "go depth 9\n"
+ expect -re "info depth 9 " {} timeout {exit 1}
+ expect "bestmove" {} timeout {exit 1}
+
+ send "position startpos moves g1f3 e7e5 e2e4\n"
+ send "go depth 8\n"
+ expect -re "info depth 8 \[^\n\]* nodes \[1-9\]" {} timeout {exit 1}
+ expect "bestmove" {} timeout {exit 1}
+
+ send "cache\n"
+ expect "Results : 2 of 4" {} timeout {exit 1}
+ expect "Hits    : 2 of 4 probes" {} timeout {exit 1}
+
+ send "ucinewgame\n"
+ send "cache\n"
+ expect "Results : 0 of 4" {} timeout {exit 1}
+
+ send "quit\n"
+ expect eof
+EOF
+
+expect cache.exp > /dev/null
+
+rm cache.exp
+
+echo "cache testing OK"
@@ -0,0 +1,76 @@
+// Count how often 'go latency <ms>' misses its deadline, measured from posting
+// 'go' to receiving 'bestmove', for targets of 5, 10 and 50 ms with 1 and 4
+// threads. 'go movetime' is shown for comparison. Run from the repository
+// root after npm run-script prepare:
+//
+//   node --experimental-wasm-threads --experimental-wasm-bulk-memory tests/deadline-misses.js
+
+const path = require("path");
+const Stockfish = require(path.join(__dirname, "..", "stockfish.js"));
+
+const positions = [
+  "startpos",
+  "fen r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+  "fen 8/2p5/3p4/KP5r/1R3p1k/8/4P1P1/8 w - - 0 11",
+  "fen 4rrk1/pp1n3p/3q2pQ/2p1pb2/2PP4/2P3N1/P2B2PP/4RRK1 b - - 7 19",
+  "fen r3r1k1/2p2ppp/p1p1bn2/8/1q2P3/2NPQN2/PPP3PP/R4RK1 b - - 2 15",
+  "fen 4rrk1/2p1b1p1/p1p3q1/4p3/2P2n1p/1P1NR2P/PB3PP1/3R1QK1 b - - 2 24",
+  "fen 6k1/6p1/6Pp/ppp5/3pn2P/1P3K2/1PP2P2/3N4 b - - 0 1",
+  "fen 8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1",
+];
+
+const runs = 5;
+
+function waitFor(sf, prefix) {
+  return new Promise((resolve) => {
+    const listener = (line) => {
+      if (!line.startsWith(prefix)) return;
+      sf.removeMessageListener(listener);
+      resolve();
+    };
+    sf.addMessageListener(listener);
+  });
+}
+
+async function measure(sf, threads, mode, ms) {
+  sf.postMessage("setoption name Threads value " + threads);
+  sf.postMessage("isready");
+  await waitFor(sf, "readyok");
+
+  const samples = [];
+  for (let i = 0; i < runs; i++)
+    for (const pos of positions) {
+      sf.postMessage("position " + pos);
+      const bestmove = waitFor(sf, "bestmove");
+      const start = process.hrtime.bigint();
+      sf.postMessage(`go ${mode} ${ms}`);
+      await bestmove;
+      samples.push(Number(process.hrtime.bigint() - start) / 1e6);
+    }
+
+  samples.sort((a, b) => a - b);
+  return samples;
+}
+
+(async () => {
+  const sf = await Stockfish();
+  sf.addMessageListener(() => {}); // Keep search output off the console
+
+  console.log("threads      mode  target  misses  median (ms)  max (ms)");
+  for (const threads of [1, 4])
+    for (const mode of ["latency", "movetime"])
+      for (const ms of [5, 10, 50]) {
+        const s = await measure(sf, threads, mode, ms);
+        console.log(
+          String(threads).padStart(7),
+          mode.padStart(9),
+          String(ms).padStart(7),
+          `${s.filter((t) => t > ms).length}/${s.length}`.padStart(7),
+          s[s.length >> 1].toFixed(1).padStart(12),
+          s[s.length - 1].toFixed(1).padStart(9)
+        );
+      }
+
+  sf.terminate();
+  process.exit(0);
+})();
@@ -0,0 +1,62 @@
+#!/bin/bash
+# verify that the hash table survives saving, loading and resizing
+
+error()
+{
+  echo "hashfile testing failed on line $1"
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+echo "hashfile testing started"
+
+# a saved table is loaded back entry for entry, a table of twice the size gets
+# a copy of each entry in both halves of its old cluster, see rehash(), and a
+# smaller one keeps some of them
+cat << EOF > hashfile.exp
+ set timeout 30
+ spawn ./stockfish
+
+ send "setoption name Hash value 16\n"
+ send "go depth 12\n"
+ expect "bestmove" {} timeout {exit 1}
+
+ send "tt stats\n"
+ expect -re "Entries +: (\[1-9\]\[0-9\]*) of" {} timeout {exit 1}
+ set entries \$expect_out(1,string)
+
+ send "hash save hashfile.bin\n"
+ expect "info string Hash save to hashfile.bin succeeded" {} timeout {exit 1}
+
+ send "ucinewgame\n"
+ send "tt stats\n"
+ expect -re "Entries +: 0 of" {} timeout {exit 1}
+
+ send "hash load hashfile.bin\n"
+ expect "info string Hash load from hashfile.bin succeeded" {} timeout {exit 1}
+ send "tt stats\n"
+ expect -re "Entries +: \$entries of" {} timeout {exit 1}
+
+ send "setoption name Hash value 32\n"
+ send "tt stats\n"
+ expect -re "Entries +: (\[0-9\]+) of" {} timeout {exit 1}
+ if {\$expect_out(1,string) != 2 * \$entries} {exit 1}
+
+ send "setoption name Hash value 4\n"
+ send "tt stats\n"
+ expect -re "Entries +: \[1-9\]\[0-9\]* of" {} timeout {exit 1}
+
+ send "hash load hashfile.bin\n"
+ expect "info string Hash load from hashfile.bin succeeded" {} timeout {exit 1}
+ send "hash load nonexistent.bin\n"
+ expect "info string Hash load from nonexistent.bin failed" {} timeout {exit 1}
+
+ send "quit\n"
+ expect eof
+EOF
+
+expect hashfile.exp > /dev/null
+
+rm hashfile.exp hashfile.bin
+
+echo "hashfile testing OK"
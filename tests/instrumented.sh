@@ -39,16 +39,16 @@ case $1 in
     threads="2"
 
 cat << EOF > tsan.supp
-race:TTEntry::move
-race:TTEntry::depth
-race:TTEntry::bound
-race:TTEntry::save
-race:TTEntry::value
-race:TTEntry::eval
-race:TTEntry::is_pv
-
-race:TranspositionTable::probe
-race:TranspositionTable::hashfull
+race:TTEntryT*::move
+race:TTEntryT*::depth
+race:TTEntryT*::bound
+race:TTEntryT*::save
+race:TTEntryT*::value
+race:TTEntryT*::eval
+race:TTEntryT*::is_pv
+
+race:TranspositionTableT*::probe
+race:TranspositionTableT*::hashfull
 
 EOF
 
@@ -0,0 +1,45 @@
+#!/bin/bash
+# verify that positions extending or taking back the moves of the previous one
+# are set up as from scratch
+
+error()
+{
+  echo "position testing failed on line $1"
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+echo "position testing started"
+
+# move lists sharing a prefix with the previous one only replay the moves after
+# it, so check the board and its key against the same position given by FEN
+cat << EOF > position.exp
+ set timeout 10
+ spawn ./stockfish
+
+ send "position startpos moves e2e4 e7e5 g1f3\n"
+ send "position startpos moves e2e4 e7e5\n"
+ send "position startpos moves e2e4 d7d5 e4d5\n"
+ send "d\n"
+ expect "Fen: rnbqkbnr/ppp1pppp/8/3P4/8/8/PPPP1PPP/RNBQKBNR b KQkq - 0 2" {} timeout {exit 1}
+ expect -re "Key: (\[0-9A-F\]+)" {} timeout {exit 1}
+ set key \$expect_out(1,string)
+
+ send "position fen rnbqkbnr/ppp1pppp/8/3P4/8/8/PPPP1PPP/RNBQKBNR b KQkq - 0 2\n"
+ send "d\n"
+ expect -re "Key: (\[0-9A-F\]+)" {} timeout {exit 1}
+ if {\$key != \$expect_out(1,string)} {exit 1}
+
+ send "position startpos moves e2e4 d7d5 e4d5 d8d5\n"
+ send "d\n"
+ expect "Fen: rnb1kbnr/ppp1pppp/8/3q4/8/8/PPPP1PPP/RNBQKBNR w KQkq - 0 3" {} timeout {exit 1}
+
+ send "quit\n"
+ expect eof
+EOF
+
+expect position.exp > /dev/null
+
+rm position.exp
+
+echo "position testing OK"
@@ -0,0 +1,46 @@
+#!/bin/bash
+# verify that searches continued from an earlier one give complete MultiPV lines
+
+error()
+{
+  echo "reuse testing failed on line $1"
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+echo "reuse testing started"
+
+# a depth 12 search that could continue from a depth 10 one, either from the
+# result cache or along the PV, must not skip iterations with MultiPV, as
+# only the first line is carried over, and must report three full lines
+cat << EOF > reuse.exp
+ set timeout 30
+ spawn ./stockfish
+ lassign \$argv cache
+
+ send "setoption name MultiPV value 3\n"
+ send "setoption name Result Cache value \$cache\n"
+ send "go depth 10\n"
+ expect -re "bestmove (\[a-h1-8qrbn\]+) ponder (\[a-h1-8qrbn\]+)" {} timeout {exit 1}
+
+ if {\$cache == 0} {
+   send "position startpos moves \$expect_out(1,string) \$expect_out(2,string)\n"
+ }
+
+ send "go depth 12\n"
+ expect -re "info depth 1 seldepth \[0-9\]+ multipv 3 " {} timeout {exit 1}
+ for {set i 1} {\$i <= 3} {incr i} {
+   expect -re "depth 12 seldepth \[0-9\]+ multipv \$i score cp -?\[0-9\]+ \[^\n\]* pv( \[a-h1-8qrbn\]+){6}" {} timeout {exit 1}
+ }
+ expect "bestmove" {} timeout {exit 1}
+
+ send "quit\n"
+ expect eof
+EOF
+
+expect reuse.exp 100 > /dev/null
+expect reuse.exp 0 > /dev/null
+
+rm reuse.exp
+
+echo "reuse testing OK"
@@ -0,0 +1,45 @@
+#!/bin/bash
+# verify that a search session searches next to the default one
+
+error()
+{
+  echo "sessions testing failed on line $1"
+  exit 1
+}
+trap 'error ${LINENO}' ERR
+
+echo "sessions testing started"
+
+# the session gets its own position, with an upper case promotion piece, and
+# answers with prefixed lines while the default session keeps searching its
+# own position until stopped
+cat << EOF > sessions.exp
+ set timeout 30
+ spawn ./stockfish
+
+ send "session new s threads 1 hash 4\n"
+ send "position startpos moves e2e4\n"
+ send "go infinite\n"
+ expect -re "\ninfo depth 1 " {} timeout {exit 1}
+
+ send "session s position fen 8/P6k/8/8/8/8/8/K7 w - - 0 1 moves a7a8Q\n"
+ send "session s go depth 8\n"
+ expect -re "session s info depth 1 " {} timeout {exit 1}
+ expect -re "session s bestmove h7\[a-h1-8\]+" {} timeout {exit 1}
+
+ send "stop\n"
+ expect -re "\nbestmove \[a-h\]\[78\]\[a-h\]\[1-8\]" {} timeout {exit 1}
+
+ send "session close s\n"
+ send "session s go depth 1\n"
+ expect "Usage: session" {} timeout {exit 1}
+
+ send "quit\n"
+ expect eof
+EOF
+
+expect sessions.exp > /dev/null
+
+rm sessions.exp
+
+echo "sessions testing OK"
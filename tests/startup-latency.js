@@ -0,0 +1,48 @@
+// Measure the time from 'setoption name Threads' to 'readyok' for 1 to 32
+// threads, with and without pre-warmed workers. The threads are only started
+// by the first command that needs them, so 'position startpos' is sent before
+// 'isready'. Run from the repository root after npm run-script prepare:
+//
+//   node --experimental-wasm-threads --experimental-wasm-bulk-memory tests/startup-latency.js
+
+const path = require("path");
+const Stockfish = require(path.join(__dirname, "..", "stockfish.js"));
+
+async function measure(threads, poolSize) {
+  const sf = await Stockfish({ pthreadPoolSize: poolSize });
+
+  const ready = () =>
+    new Promise((resolve) => {
+      const listener = (line) => {
+        if (line !== "readyok") return;
+        sf.removeMessageListener(listener);
+        resolve();
+      };
+      sf.addMessageListener(listener);
+      sf.postMessage("isready");
+    });
+
+  await ready();
+  const start = process.hrtime.bigint();
+  sf.postMessage("setoption name Threads value " + threads);
+  sf.postMessage("position startpos");
+  await ready();
+  const ms = Number(process.hrtime.bigint() - start) / 1e6;
+
+  sf.terminate();
+  return ms;
+}
+
+(async () => {
+  console.log("threads  on-demand (ms)  pre-warmed (ms)");
+  for (const threads of [1, 2, 4, 8, 16, 32]) {
+    const cold = await measure(threads, 1);
+    const warm = await measure(threads, threads);
+    console.log(
+      String(threads).padStart(7),
+      cold.toFixed(1).padStart(15),
+      warm.toFixed(1).padStart(16)
+    );
+  }
+  process.exit(0);
+})();
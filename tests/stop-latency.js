@@ -0,0 +1,71 @@
+// Measure the time from posting 'stop' to receiving 'bestmove' during an
+// infinite search, with 1 and 4 threads, and with the 'stop' posted behind
+// other commands. Run from the repository root after npm run-script prepare:
+//
+//   node --experimental-wasm-threads --experimental-wasm-bulk-memory tests/stop-latency.js
+
+const path = require("path");
+const Stockfish = require(path.join(__dirname, "..", "stockfish.js"));
+
+const positions = [
+  "startpos",
+  "fen r3k2r/p1ppqpb1/bn2pnp1/3PN3/1p2P3/2N2Q1p/PPPBBPPP/R3K2R w KQkq - 0 10",
+  "fen 4rrk1/2p1b1p1/p1p3q1/4p3/2P2n1p/1P1NR2P/PB3PP1/3R1QK1 b - - 2 24",
+  "fen 8/8/8/8/5kp1/P7/8/1K1N4 w - - 0 1",
+];
+
+const sleep = (ms) => new Promise((resolve) => setTimeout(resolve, ms));
+
+function waitFor(sf, prefix) {
+  return new Promise((resolve) => {
+    const listener = (line) => {
+      if (!line.startsWith(prefix)) return;
+      sf.removeMessageListener(listener);
+      resolve();
+    };
+    sf.addMessageListener(listener);
+  });
+}
+
+async function measure(sf, threads, busy) {
+  sf.postMessage("setoption name Threads value " + threads);
+  sf.postMessage("isready");
+  await waitFor(sf, "readyok");
+
+  const samples = [];
+  for (const pos of positions) {
+    sf.postMessage("position " + pos);
+    sf.postMessage("go infinite");
+    await sleep(500);
+
+    const bestmove = waitFor(sf, "bestmove");
+    const start = process.hrtime.bigint();
+    if (busy) sf.postMessage("eval");
+    sf.postMessage("stop");
+    await bestmove;
+    samples.push(Number(process.hrtime.bigint() - start) / 1e6);
+  }
+
+  samples.sort((a, b) => a - b);
+  return samples;
+}
+
+(async () => {
+  const sf = await Stockfish();
+  sf.addMessageListener(() => {}); // Keep search output off the console
+
+  console.log("threads  queued  min (ms)  max (ms)");
+  for (const threads of [1, 4])
+    for (const busy of [false, true]) {
+      const s = await measure(sf, threads, busy);
+      console.log(
+        String(threads).padStart(7),
+        String(busy).padStart(7),
+        s[0].toFixed(1).padStart(9),
+        s[s.length - 1].toFixed(1).padStart(9)
+      );
+    }
+
+  sf.terminate();
+  process.exit(0);
+})();